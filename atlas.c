@@ -0,0 +1,429 @@
+#include "atlas.h"
+
+#define ATLAS_PAGEMAGIC "ATLP"
+#define ATLAS_INDEXMAGIC "ATLI"
+#define ATLAS_HEADER 12
+#define ATLAS_RECTWORDS 6
+#define ATLAS_NAMELEN 32
+
+// pages are stored as little endian ARGB words
+#define ATLAS_AMASK 0xFF000000
+#define ATLAS_RMASK 0x00FF0000
+#define ATLAS_GMASK 0x0000FF00
+#define ATLAS_BMASK 0x000000FF
+
+struct atlasslot {
+	SDL_Surface *image;
+	int page, x, y;
+};
+
+struct atlaspage {
+	int w, h;
+	SDL_Surface *canvas;
+	Uint8 *data;
+	Uint32 size;
+};
+
+static struct atlasslot *sortSlots;
+
+static Uint32 atlasWord(const Uint8 *p)
+{
+	Uint32 v;
+
+	memcpy(&v, p, 4);
+	return sgeByteSwap32(v);
+}
+
+static void atlasPutWord(Uint8 *p, Uint32 v)
+{
+	v = sgeByteSwap32(v);
+	memcpy(p, &v, 4);
+}
+
+static unsigned int atlasHash(const char *name)
+{
+	unsigned int h = 2166136261u;
+
+	while (*name)
+		h = (h ^ (unsigned char)*name++) * 16777619u;
+	return h ^ h >> 15;
+}
+
+// tallest first, then widest, so every shelf is as high as its first image
+static int atlasCompare(const void *a, const void *b)
+{
+	SDL_Surface *x = sortSlots[*(const int *)a].image, *y = sortSlots[*(const int *)b].image;
+
+	if (x->h != y->h)
+		return y->h - x->h;
+	return y->w - x->w;
+}
+
+static int atlasShelve(struct atlasslot *slots, int *order, int numImages, struct atlaspage *pages)
+{
+	int numPages = 0, open = -1;
+	int i, x = 0, shelfY = 0, shelfHeight = 0;
+	struct atlasslot *s;
+
+	for (i = 0; i < numImages; i++) {
+		s = &slots[order[i]];
+		if (s->image->w > ATLAS_PAGESIZE || s->image->h > ATLAS_PAGESIZE) {
+			s->page = numPages++;
+			s->x = s->y = 0;
+			pages[s->page].w = s->image->w;
+			pages[s->page].h = s->image->h;
+			continue;
+		}
+		if (open >= 0 && x + s->image->w > ATLAS_PAGESIZE) {
+			shelfY += shelfHeight;
+			x = shelfHeight = 0;
+		}
+		if (open < 0 || shelfY + s->image->h > ATLAS_PAGESIZE) {
+			open = numPages++;
+			x = shelfY = shelfHeight = 0;
+		}
+		s->page = open;
+		s->x = x;
+		s->y = shelfY;
+		x += s->image->w;
+		shelfHeight = MAX(shelfHeight, s->image->h);
+		// pages are cut down to what they use
+		pages[open].w = MAX(pages[open].w, x);
+		pages[open].h = MAX(pages[open].h, shelfY + s->image->h);
+	}
+	return numPages;
+}
+
+static void atlasSerialize(struct atlaspage *page)
+{
+	Uint8 *out, *row;
+	int x, y;
+
+	page->size = ATLAS_HEADER + page->w * page->h * 4;
+	sgeMallocNoInit(page->data, Uint8, page->size);
+	memcpy(page->data, ATLAS_PAGEMAGIC, 4);
+	atlasPutWord(page->data + 4, page->w);
+	atlasPutWord(page->data + 8, page->h);
+	out = page->data + ATLAS_HEADER;
+	for (y = 0; y < page->h; y++) {
+		row = (Uint8 *)page->canvas->pixels + y * page->canvas->pitch;
+		for (x = 0; x < page->w; x++, out += 4)
+			atlasPutWord(out, ((Uint32 *)row)[x]);
+	}
+}
+
+static Uint8 *atlasIndex(char *images[], struct atlasslot *slots, int numImages, int numPages, Uint32 *size)
+{
+	Uint8 *index, *out;
+	Uint32 length;
+	int i;
+
+	*size = ATLAS_HEADER;
+	for (i = 0; i < numImages; i++)
+		*size += ATLAS_RECTWORDS * 4 + strlen(images[i]);
+	sgeMallocNoInit(index, Uint8, *size);
+	memcpy(index, ATLAS_INDEXMAGIC, 4);
+	atlasPutWord(index + 4, numPages);
+	atlasPutWord(index + 8, numImages);
+	out = index + ATLAS_HEADER;
+	for (i = 0; i < numImages; i++) {
+		length = strlen(images[i]);
+		atlasPutWord(out, slots[i].page);
+		atlasPutWord(out + 4, slots[i].x);
+		atlasPutWord(out + 8, slots[i].y);
+		atlasPutWord(out + 12, slots[i].image->w);
+		atlasPutWord(out + 16, slots[i].image->h);
+		atlasPutWord(out + 20, length);
+		memcpy(out + ATLAS_RECTWORDS * 4, images[i], length);
+		out += ATLAS_RECTWORDS * 4 + length;
+	}
+	return index;
+}
+
+int atlasCreate(const char *filename, char *images[], int numImages, char *files[], int numFiles, const char *key, int flags)
+{
+	struct atlasslot *slots;
+	struct atlaspage *pages;
+	struct packsource *sources;
+	SDL_Rect place;
+	char *pageNames;
+	int *order;
+	int i, numPages = 0, ok = 1;
+	Uint8 *index = NULL;
+	Uint32 indexSize;
+
+	sgeMalloc(slots, struct atlasslot, numImages + 1);
+	sgeMalloc(pages, struct atlaspage, numImages + 1);
+	sgeMalloc(order, int, numImages + 1);
+	for (i = 0; ok && i < numImages; i++) {
+		order[i] = i;
+		slots[i].image = IMG_Load(images[i]);
+		if (!slots[i].image) {
+			fprintf(stderr, "could not load %s\n", images[i]);
+			ok = 0;
+		}
+	}
+
+	if (ok) {
+		sortSlots = slots;
+		qsort(order, numImages, sizeof(int), atlasCompare);
+		numPages = atlasShelve(slots, order, numImages, pages);
+	}
+	for (i = 0; ok && i < numPages; i++) {
+		pages[i].canvas = SDL_CreateRGBSurface(SDL_SWSURFACE, pages[i].w, pages[i].h, 32, ATLAS_RMASK, ATLAS_GMASK, ATLAS_BMASK, ATLAS_AMASK);
+		if (!pages[i].canvas)
+			ok = 0;
+	}
+	for (i = 0; ok && i < numImages; i++) {
+		place.x = slots[i].x;
+		place.y = slots[i].y;
+		// copy the alpha channel instead of blending onto the empty page
+		SDL_SetAlpha(slots[i].image, 0, 0);
+		SDL_BlitSurface(slots[i].image, NULL, pages[slots[i].page].canvas, &place);
+	}
+	for (i = 0; ok && i < numPages; i++)
+		atlasSerialize(&pages[i]);
+
+	if (ok) {
+		index = atlasIndex(images, slots, numImages, numPages, &indexSize);
+		sgeMalloc(sources, struct packsource, numFiles + numPages + 1);
+		sgeMalloc(pageNames, char, numPages * ATLAS_NAMELEN + 1);
+		for (i = 0; i < numFiles; i++)
+			sources[i].name = files[i];
+		for (i = 0; i < numPages; i++) {
+			snprintf(pageNames + i * ATLAS_NAMELEN, ATLAS_NAMELEN, ATLAS_PAGE, i);
+			sources[numFiles + i].name = pageNames + i * ATLAS_NAMELEN;
+			sources[numFiles + i].data = pages[i].data;
+			sources[numFiles + i].size = pages[i].size;
+		}
+		sources[numFiles + numPages].name = ATLAS_INDEX;
+		sources[numFiles + numPages].data = index;
+		sources[numFiles + numPages].size = indexSize;
+		ok = packCreateSources(filename, sources, numFiles + numPages + 1, key, flags);
+		free(pageNames);
+		free(sources);
+	}
+
+	for (i = 0; i < numImages; i++) {
+		if (slots[i].image)
+			SDL_FreeSurface(slots[i].image);
+	}
+	for (i = 0; i < numPages; i++) {
+		if (pages[i].canvas)
+			SDL_FreeSurface(pages[i].canvas);
+		free(pages[i].data);
+	}
+	free(index);
+	free(order);
+	free(pages);
+	free(slots);
+	return ok;
+}
+
+// decoded and converted for drawing, SDL_DisplayFormatAlpha() always gives
+// a software surface so views can point into its pixels
+static SDL_Surface *atlasLoadPage(struct pack *p, int page)
+{
+	SDL_Surface *raw, *display;
+	const Uint8 *data;
+	char name[ATLAS_NAMELEN];
+	Uint32 size, w, h, x, y;
+
+	snprintf(name, ATLAS_NAMELEN, ATLAS_PAGE, page);
+	data = packRead(p, name, &size);
+	if (!data)
+		return NULL;
+	w = size >= ATLAS_HEADER ? atlasWord(data + 4) : 0;
+	h = size >= ATLAS_HEADER ? atlasWord(data + 8) : 0;
+	if (size < ATLAS_HEADER || memcmp(data, ATLAS_PAGEMAGIC, 4) ||
+	    !w || !h || w > 0x4000 || h > 0x4000 || size != ATLAS_HEADER + w * h * 4) {
+		packRelease(p, data);
+		return NULL;
+	}
+	raw = SDL_CreateRGBSurface(SDL_SWSURFACE, w, h, 32, ATLAS_RMASK, ATLAS_GMASK, ATLAS_BMASK, ATLAS_AMASK);
+	if (raw) {
+		for (y = 0; y < h; y++) {
+			for (x = 0; x < w; x++)
+				((Uint32 *)((Uint8 *)raw->pixels + y * raw->pitch))[x] = atlasWord(data + ATLAS_HEADER + (y * w + x) * 4);
+		}
+	}
+	packRelease(p, data);
+	if (!raw)
+		return NULL;
+	display = SDL_DisplayFormatAlpha(raw);
+	SDL_FreeSurface(raw);
+	return display;
+}
+
+static int atlasParse(struct atlas *a, const Uint8 *index, Uint32 size)
+{
+	struct atlasrect *r;
+	Uint32 offset = ATLAS_HEADER, length;
+	int i;
+
+	if (size < ATLAS_HEADER || memcmp(index, ATLAS_INDEXMAGIC, 4))
+		return 0;
+	a->numPages = atlasWord(index + 4);
+	a->numRects = atlasWord(index + 8);
+	if (a->numPages < 0 || a->numRects < 0 || (Uint32)a->numRects > size / (ATLAS_RECTWORDS * 4))
+		return 0;
+	sgeMalloc(a->rects, struct atlasrect, a->numRects + 1);
+	for (i = 0; i < a->numRects; i++) {
+		r = &a->rects[i];
+		if (size - offset < ATLAS_RECTWORDS * 4)
+			return 0;
+		r->page = atlasWord(index + offset);
+		r->rect.x = atlasWord(index + offset + 4);
+		r->rect.y = atlasWord(index + offset + 8);
+		r->rect.w = atlasWord(index + offset + 12);
+		r->rect.h = atlasWord(index + offset + 16);
+		length = atlasWord(index + offset + 20);
+		offset += ATLAS_RECTWORDS * 4;
+		if (r->page < 0 || r->page >= a->numPages || length > size - offset)
+			return 0;
+		sgeMalloc(r->name, char, length + 1);
+		memcpy(r->name, index + offset, length);
+		offset += length;
+	}
+	return 1;
+}
+
+struct atlas *atlasOpen(struct pack *p)
+{
+	struct atlas *a;
+	struct atlasrect *r;
+	const void *index;
+	unsigned int mask, h;
+	Uint32 size;
+	int i, ok;
+
+	index = packRead(p, ATLAS_INDEX, &size);
+	if (!index)
+		return NULL;
+	sgeNew(a, struct atlas);
+	ok = atlasParse(a, index, size);
+	packRelease(p, index);
+	if (ok) {
+		sgeMalloc(a->pages, SDL_Surface *, a->numPages + 1);
+		for (i = 0; ok && i < a->numPages; i++)
+			ok = (a->pages[i] = atlasLoadPage(p, i)) != NULL;
+	}
+	for (i = 0; ok && i < a->numRects; i++) {
+		r = &a->rects[i];
+		ok = r->rect.x >= 0 && r->rect.y >= 0 &&
+			r->rect.x + r->rect.w <= a->pages[r->page]->w && r->rect.y + r->rect.h <= a->pages[r->page]->h;
+	}
+	if (!ok) {
+		fprintf(stderr, "%s\n", "the atlas is damaged");
+		atlasClose(a);
+		return NULL;
+	}
+
+	for (a->lookupSize = 16; a->lookupSize < (unsigned int)a->numRects * 2; a->lookupSize *= 2)
+		;
+	mask = a->lookupSize - 1;
+	sgeMallocNoInit(a->lookup, int, a->lookupSize);
+	memset(a->lookup, -1, a->lookupSize * sizeof(int));
+	for (i = 0; i < a->numRects; i++) {
+		h = atlasHash(a->rects[i].name) & mask;
+		while (a->lookup[h] >= 0 && strcmp(a->rects[a->lookup[h]].name, a->rects[i].name))
+			h = (h + 1) & mask;
+		if (a->lookup[h] < 0)
+			a->lookup[h] = i;
+	}
+	return a;
+}
+
+void atlasClose(struct atlas *a)
+{
+	int i;
+
+	if (a->pages) {
+		for (i = 0; i < a->numPages; i++) {
+			if (a->pages[i])
+				SDL_FreeSurface(a->pages[i]);
+		}
+		sgeFree(a->pages);
+	}
+	if (a->rects) {
+		for (i = 0; i < a->numRects; i++)
+			sgeFree(a->rects[i].name);
+		sgeFree(a->rects);
+	}
+	sgeFree(a->lookup);
+	free(a);
+}
+
+const struct atlasrect *atlasFind(struct atlas *a, const char *name)
+{
+	unsigned int mask = a->lookupSize - 1;
+	unsigned int i = atlasHash(name) & mask;
+
+	while (a->lookup[i] >= 0) {
+		if (!strcmp(a->rects[a->lookup[i]].name, name))
+			return &a->rects[a->lookup[i]];
+		i = (i + 1) & mask;
+	}
+	return NULL;
+}
+
+SDL_Surface *atlasSurface(struct atlas *a, const char *name)
+{
+	const struct atlasrect *r = atlasFind(a, name);
+	SDL_PixelFormat *f;
+	SDL_Surface *page, *view;
+
+	if (!r)
+		return NULL;
+	page = a->pages[r->page];
+	f = page->format;
+	view = SDL_CreateRGBSurfaceFrom((Uint8 *)page->pixels + r->rect.y * page->pitch + r->rect.x * f->BytesPerPixel,
+		r->rect.w, r->rect.h, f->BitsPerPixel, page->pitch, f->Rmask, f->Gmask, f->Bmask, f->Amask);
+	if (view)
+		SDL_SetAlpha(view, SDL_SRCALPHA, SDL_ALPHA_OPAQUE);
+	return view;
+}
+
+SGESPRITEIMAGE *atlasSpriteImage(struct atlas *a, const char *name)
+{
+	SGESPRITEIMAGE *image;
+	SDL_Surface *view = atlasSurface(a, name);
+
+	if (!view)
+		return NULL;
+	image = sgeSpriteImageNew();
+	sgeSpriteImageSetImage(image, view);
+	return image;
+}
+
+SGESPRITE *atlasSpriteRange(struct atlas *a, const char *templ, Uint32 start, Uint32 end)
+{
+	char name[MAXFILENAMELEN];
+	SGESPRITEIMAGE *image;
+	SGESPRITE *s = sgeSpriteNew();
+	Uint32 i;
+
+	for (i = start; i <= end; i++) {
+		snprintf(name, MAXFILENAMELEN, templ, i);
+		image = atlasSpriteImage(a, name);
+		if (!image) {
+			fprintf(stderr, "%s is not in the atlas\n", name);
+			sgeSpriteDestroy(s);
+			return NULL;
+		}
+		sgeSpriteAddSpriteImage(s, image);
+	}
+	return s;
+}
+
+SGESPRITE *atlasSprite(struct atlas *a, const char *name)
+{
+	SGESPRITEIMAGE *image = atlasSpriteImage(a, name);
+	SGESPRITE *s;
+
+	if (!image)
+		return NULL;
+	s = sgeSpriteNew();
+	sgeSpriteAddSpriteImage(s, image);
+	return s;
+}
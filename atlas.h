@@ -0,0 +1,55 @@
+#ifndef _ATLAS_H
+#define _ATLAS_H
+
+#include <sge.h>
+#include "pack.h"
+
+#define ATLAS_PAGESIZE 1024
+#define ATLAS_INDEX "atlas/index"
+#define ATLAS_PAGE "atlas/page%d"
+
+/*
+ * Texture atlases inside packs. atlasCreate() decodes the given images
+ * at build time and packs them onto ATLAS_PAGESIZE square pages, shelf by
+ * shelf, tallest first; an image too big for a page gets one of its own.
+ * Pages are stored as raw 32 bit pixels, the ATLAS_INDEX entry maps each
+ * image name to its page and rectangle. The images themselves are not
+ * stored, everything else is written as packCreate() would.
+ *
+ * At run time the pages are converted to the display format once and
+ * kept in system memory. Sprite images handed out are views, surfaces
+ * sharing the page's pixels and pitch, so drawing all frames of all
+ * sprites touches a few large surfaces instead of one small one each.
+ * Views don't own their pixels, the atlas must outlive them.
+ */
+struct atlasrect {
+	char *name;
+	int page;
+	SDL_Rect rect;
+};
+
+struct atlas {
+	int numPages;
+	SDL_Surface **pages;
+	int numRects;
+	struct atlasrect *rects;
+	// open addressing over rect indices, -1 marks a free slot
+	int *lookup;
+	unsigned int lookupSize;
+};
+
+int atlasCreate(const char *filename, char *images[], int numImages, char *files[], int numFiles, const char *key, int flags);
+
+// NULL if the pack has no atlas or it is damaged
+struct atlas *atlasOpen(struct pack *p);
+void atlasClose(struct atlas *a);
+
+// NULL if name is not in the atlas
+const struct atlasrect *atlasFind(struct atlas *a, const char *name);
+SDL_Surface *atlasSurface(struct atlas *a, const char *name);
+SGESPRITEIMAGE *atlasSpriteImage(struct atlas *a, const char *name);
+// like sgeSpriteNewFile() and sgeSpriteNewFileRange(), every frame a view
+SGESPRITE *atlasSprite(struct atlas *a, const char *name);
+SGESPRITE *atlasSpriteRange(struct atlas *a, const char *templ, Uint32 start, Uint32 end);
+
+#endif
@@ -0,0 +1,350 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sge.h>
+#include "framesched.h"
+
+#define WIDTH 640
+#define HEIGHT 480
+// every measurement runs at least this long, the median of BENCH_RUNS is reported
+#define BENCH_MINTIME 100000000ull
+#define BENCH_RUNS 5
+// a case more than this much slower than the baseline fails the run
+#define BENCH_TOLERANCE 0.10
+#define BENCH_OUTPUT "bench.csv"
+
+#define FONTARCHIVE "bench.d"
+#define FONTFILE "benchfont.png"
+#define FONTMAP "benchfont.png.map"
+#define FONTKEY "bench"
+#define GLYPHWIDTH 6
+#define GLYPHHEIGHT 9
+
+#define PATHSIZE 64
+
+struct bench {
+	const char *name;
+	void (*setup)(struct bench *b);
+	void (*op)(void);
+	// work done by one op, for the throughput column
+	double items;
+	const char *unit;
+	double nsPerOp;
+};
+
+static SGESPRITEIMAGE *imageA, *imageB;
+static SGESPRITEGROUP *groupA, *groupB;
+static SDL_Surface *source;
+static SGEFONT *font;
+static SGEPARTICLES *particles;
+static SGEPATHFINDER *path;
+static const char *text = "Terraria ... in ... SPAAAAAAACE!!! 0123";
+
+// a filled disc, transparent around it
+static SDL_Surface *benchDisc(int size)
+{
+	SDL_Surface *s = sgeCreateSDLSurface(size, size, 32, SDL_SRCALPHA);
+	int x, y, r = size / 2;
+
+	for (y = 0; y < size; y++) {
+		for (x = 0; x < size; x++) {
+			if ((x - r) * (x - r) + (y - r) * (y - r) < r * r)
+				sgeFillRect(s, x, y, 1, 1, 0xFFC08040);
+			else
+				sgeFillRect(s, x, y, 1, 1, 0x00000000);
+		}
+	}
+	return s;
+}
+
+static void setupImageCollide(struct bench *b)
+{
+	imageA = sgeSpriteImageNew();
+	imageB = sgeSpriteImageNew();
+	sgeSpriteImageSetImage(imageA, benchDisc(64));
+	sgeSpriteImageSetImage(imageB, benchDisc(64));
+	sgeSpriteImageUseAlpha(imageA);
+	sgeSpriteImageUseAlpha(imageB);
+	// overlapping corners, both discs miss the shared quarter
+	imageB->x = 40;
+	imageB->y = 40;
+	b->items = 24 * 24;
+}
+
+static void opImageCollide(void)
+{
+	sgeSpriteImageCollide(imageA, imageB);
+}
+
+static void setupGroupCollide(struct bench *b)
+{
+	SGESPRITE *s;
+	int i;
+
+	groupA = sgeSpriteGroupNew();
+	groupB = sgeSpriteGroupNew();
+	for (i = 0; i < 64; i++) {
+		s = sgeSpriteNewSDLSurface(benchDisc(16));
+		s->x = (i % 8) * 40;
+		s->y = (i / 8) * 40;
+		sgeSpriteGroupAddSprite(groupA, s);
+		s = sgeSpriteNewSDLSurface(benchDisc(16));
+		s->x = (i % 8) * 40 + 20;
+		s->y = (i / 8) * 40 + 20;
+		sgeSpriteGroupAddSprite(groupB, s);
+	}
+	b->items = 64 * 64;
+}
+
+static void opGroupCollide(void)
+{
+	sgeSpriteGroupCollide(groupA, groupB);
+}
+
+static void setupRotoZoom(struct bench *b)
+{
+	SDL_Surface *result;
+
+	source = benchDisc(128);
+	result = sgeRotoZoom(source, 0.5, 1.5);
+	b->items = result->w * result->h;
+	SDL_FreeSurface(result);
+}
+
+static void opRotoZoom(void)
+{
+	SDL_FreeSurface(sgeRotoZoom(source, 0.5, 1.5));
+}
+
+static void setupGrey(struct bench *b)
+{
+	source = benchDisc(256);
+	b->items = 256 * 256;
+}
+
+static void opGrey(void)
+{
+	SDL_FreeSurface(sgeConvertToGrey(source));
+}
+
+static void setupLine(struct bench *b)
+{
+	b->items = WIDTH;
+}
+
+static void opLine(void)
+{
+	sgeDrawLine(screen, 0, 0, WIDTH - 1, HEIGHT - 1, 0xFFFFFFFF);
+}
+
+static void setupFillRect(struct bench *b)
+{
+	b->items = 256 * 256;
+}
+
+static void opFillRect(void)
+{
+	sgeFillRect(screen, 100, 100, 256, 256, 0xFF4080C0);
+}
+
+/*
+ * Builds a bitmap font with every printable character, glyphs separated
+ * by pink columns, packs it into a throwaway archive and loads it back.
+ * SDL_image detects the format from the data, so a BMP does as the png.
+ */
+static void setupFont(struct bench *b)
+{
+	char *files[] = {FONTFILE, FONTMAP};
+	char map[96];
+	SDL_Surface *s;
+	SGEFILE *f;
+	FILE *out;
+	int i;
+
+	s = sgeCreateSDLSurface(95 * (GLYPHWIDTH + 1), GLYPHHEIGHT, 32, 0);
+	for (i = 0; i < 95; i++) {
+		map[i] = ' ' + i;
+		if (i)
+			sgeFillRect(s, i * (GLYPHWIDTH + 1) + 1, 1, GLYPHWIDTH - 2, GLYPHHEIGHT - 2, 0xFFFFFFFF);
+		sgeFillRect(s, i * (GLYPHWIDTH + 1) + GLYPHWIDTH, 0, 1, GLYPHHEIGHT, 0xFFFF00FF);
+	}
+	map[95] = 0;
+	SDL_SaveBMP(s, FONTFILE);
+	SDL_FreeSurface(s);
+	out = fopen(FONTMAP, "w");
+	if (!out)
+		sgeBailOut("could not write %s\n", FONTMAP);
+	fputs(map, out);
+	fclose(out);
+
+	sgeCreateFile(FONTARCHIVE, files, 2, FONTKEY);
+	f = sgeOpenFile(FONTARCHIVE, FONTKEY);
+	font = sgeFontNewFileBitmap(f, FONTFILE);
+	sgeCloseFile(f);
+	unlink(FONTARCHIVE);
+	unlink(FONTFILE);
+	unlink(FONTMAP);
+	b->items = strlen(text);
+}
+
+static void opFont(void)
+{
+	sgeFontPrintBitmap(font, screen, 10, 200, text);
+}
+
+static void setupParticles(struct bench *b)
+{
+	int i;
+
+	particles = sgeParticlesPixelNew(255, 255, 0, 255, 64, 0);
+	particles->infinite = YES;
+	particles->x = WIDTH / 2;
+	particles->y = HEIGHT / 2;
+	particles->emission = 40;
+	particles->timeToLive = 50;
+	particles->timeToLiveDistribution = 20;
+	particles->speed = 3;
+	particles->speedDistribution = 2;
+	particles->angle = 270;
+	particles->angleDistribution = 60;
+	particles->gravity = 0.1;
+	// run into the steady state of about emission * timeToLive particles
+	for (i = 0; i < 200; i++)
+		sgeParticlesDraw(particles);
+	b->items = particles->particles->numberOfElements;
+}
+
+static void opParticles(void)
+{
+	sgeParticlesDraw(particles);
+}
+
+// walls across the grid with alternating gaps, the path snakes through
+static void setupPath(struct bench *b)
+{
+	int x, y;
+
+	path = sgePathFinderNew(PATHSIZE, PATHSIZE);
+	for (y = 4; y < PATHSIZE; y += 4) {
+		for (x = 0; x < PATHSIZE; x++)
+			sgePathFinderSet(path, x, y, 1);
+		sgePathFinderSet(path, (y / 4) % 2 ? PATHSIZE - 2 : 1, y, 0);
+	}
+	if (!sgePathFinderFind(path, 0, 0, PATHSIZE - 1, PATHSIZE - 1))
+		sgeBailOut("%s\n", "benchmark maze has no path");
+	b->items = PATHSIZE * PATHSIZE;
+}
+
+static void opPath(void)
+{
+	sgePathFinderFind(path, 0, 0, PATHSIZE - 1, PATHSIZE - 1);
+}
+
+static struct bench benches[] = {
+	{"sgeSpriteImageCollide", setupImageCollide, opImageCollide, 0, "pixels", 0},
+	{"sgeSpriteGroupCollide", setupGroupCollide, opGroupCollide, 0, "pairs", 0},
+	{"sgeRotoZoom", setupRotoZoom, opRotoZoom, 0, "pixels", 0},
+	{"sgeConvertToGrey", setupGrey, opGrey, 0, "pixels", 0},
+	{"sgeDrawLine", setupLine, opLine, 0, "pixels", 0},
+	{"sgeFillRect", setupFillRect, opFillRect, 0, "pixels", 0},
+	{"sgeFontPrintBitmap", setupFont, opFont, 0, "glyphs", 0},
+	{"sgeParticlesDraw", setupParticles, opParticles, 0, "particles", 0},
+	{"sgePathFinderFind", setupPath, opPath, 0, "cells", 0},
+};
+#define NUMBENCHES (sizeof(benches) / sizeof(benches[0]))
+
+static Uint64 benchTime(struct bench *b, Uint32 iterations)
+{
+	Uint64 start = frameSchedNow();
+	Uint32 i;
+
+	for (i = 0; i < iterations; i++)
+		b->op();
+	return frameSchedNow() - start;
+}
+
+static int benchCompare(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+	return x < y ? -1 : x > y;
+}
+
+static void benchRun(struct bench *b)
+{
+	double runs[BENCH_RUNS];
+	Uint32 iterations = 1;
+	int i;
+
+	b->setup(b);
+	while (benchTime(b, iterations) < BENCH_MINTIME && iterations < 0x40000000)
+		iterations *= 2;
+	for (i = 0; i < BENCH_RUNS; i++)
+		runs[i] = (double)benchTime(b, iterations) / iterations;
+	qsort(runs, BENCH_RUNS, sizeof(double), benchCompare);
+	b->nsPerOp = runs[BENCH_RUNS / 2];
+}
+
+// reads ns/op for name from an earlier output file, 0 if not found
+static double benchBaseline(const char *filename, const char *name)
+{
+	char line[256], found[128];
+	double ns = 0, value;
+	FILE *f;
+
+	f = fopen(filename, "r");
+	if (!f)
+		sgeBailOut("could not read baseline %s\n", filename);
+	while (fgets(line, sizeof(line), f)) {
+		if (sscanf(line, "%127[^,],%lf", found, &value) == 2 && !strcmp(found, name))
+			ns = value;
+	}
+	fclose(f);
+	return ns;
+}
+
+/*
+ * Times the libsge draw and collision primitives on an offscreen screen.
+ * Usage: bench [output.csv [baseline.csv]]
+ * With a baseline the change per case is shown and the exit code is
+ * non-zero if any case got slower by more than BENCH_TOLERANCE.
+ */
+int run(int argc, char **argv)
+{
+	const char *output = argc > 1 ? argv[1] : BENCH_OUTPUT;
+	const char *baseline = argc > 2 ? argv[2] : NULL;
+	struct bench *b;
+	double before, change;
+	int regressed = 0;
+	FILE *f;
+	Uint32 i;
+
+	setenv("SDL_VIDEODRIVER", "dummy", 1);
+	sgeInit(NOAUDIO, NOJOYSTICK);
+	sgeOpenScreen("bench", WIDTH, HEIGHT, 32, NOFULLSCREEN);
+
+	f = fopen(output, "w");
+	if (!f)
+		sgeBailOut("could not write %s\n", output);
+	fprintf(f, "name,ns_per_op,ops_per_sec,items_per_sec,unit\n");
+
+	printf("%-24s %12s %12s %16s\n", "", "ns/op", "ops/s", "throughput");
+	for (i = 0; i < NUMBENCHES; i++) {
+		b = &benches[i];
+		benchRun(b);
+		printf("%-24s %12.1f %12.0f %12.3fM %s", b->name, b->nsPerOp,
+			1e9 / b->nsPerOp, b->items * 1e3 / b->nsPerOp, b->unit);
+		fprintf(f, "%s,%.1f,%.0f,%.0f,%s\n", b->name, b->nsPerOp,
+			1e9 / b->nsPerOp, b->items * 1e9 / b->nsPerOp, b->unit);
+		if (baseline && (before = benchBaseline(baseline, b->name)) > 0) {
+			change = b->nsPerOp / before - 1;
+			printf(" %+6.1f%%%s", change * 100, change > BENCH_TOLERANCE ? " REGRESSED" : "");
+			regressed |= change > BENCH_TOLERANCE;
+		}
+		printf("\n");
+		fflush(stdout);
+	}
+	fclose(f);
+
+	sgeCloseScreen();
+	return regressed;
+}
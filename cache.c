@@ -0,0 +1,386 @@
+#include <stdint.h>
+#include "cache.h"
+
+#define CACHE_INITIALBUCKETS 64
+
+struct cachename {
+	struct pack *pack;
+	char *name;
+	struct cacheasset *asset;
+	struct cachename *next;
+	// further names of the same asset
+	struct cachename *sibling;
+};
+
+struct cacheasset {
+	int type;
+	void *resource;
+	// NULL unless the cache deduplicates
+	char *digest;
+	Uint32 bytes;
+	int refs;
+	struct cachename *names;
+	struct cacheasset *nextDigest, *nextResource;
+	// links in the eviction order while unreferenced
+	struct cacheasset *newer, *older;
+};
+
+static unsigned int cacheHashString(const char *s, unsigned int h)
+{
+	while (*s)
+		h = (h ^ (unsigned char)*s++) * 16777619u;
+	return h ^ h >> 15;
+}
+
+static unsigned int cacheNameHash(struct pack *p, const char *name)
+{
+	return cacheHashString(name, 2166136261u ^ (unsigned int)(uintptr_t)p * 0x9E3779B1u);
+}
+
+static unsigned int cacheDigestHash(int type, const char *digest)
+{
+	return cacheHashString(digest, 2166136261u + type);
+}
+
+static unsigned int cachePointerHash(const void *p)
+{
+	uint32_t h = (uint32_t)(uintptr_t)p * 0x9E3779B1u;
+	h ^= h >> 16;
+	h *= 0x7FEB352Du;
+	h ^= h >> 15;
+	return h;
+}
+
+static void cacheGrowNames(struct cache *c)
+{
+	struct cachename **old = c->names, *n;
+	unsigned int oldBuckets = c->nameBuckets, i, h;
+
+	c->nameBuckets = oldBuckets ? oldBuckets * 2 : CACHE_INITIALBUCKETS;
+	sgeMalloc(c->names, struct cachename *, c->nameBuckets);
+	for (i = 0; i < oldBuckets; i++) {
+		while ((n = old[i])) {
+			old[i] = n->next;
+			h = cacheNameHash(n->pack, n->name) & (c->nameBuckets - 1);
+			n->next = c->names[h];
+			c->names[h] = n;
+		}
+	}
+	free(old);
+}
+
+static void cacheGrowAssets(struct cache *c)
+{
+	struct cacheasset **oldDigests = c->digests, **oldResources = c->resources, *a;
+	unsigned int oldBuckets = c->assetBuckets, i, h;
+
+	c->assetBuckets = oldBuckets ? oldBuckets * 2 : CACHE_INITIALBUCKETS;
+	sgeMalloc(c->digests, struct cacheasset *, c->assetBuckets);
+	sgeMalloc(c->resources, struct cacheasset *, c->assetBuckets);
+	for (i = 0; i < oldBuckets; i++) {
+		while ((a = oldDigests[i])) {
+			oldDigests[i] = a->nextDigest;
+			h = cacheDigestHash(a->type, a->digest) & (c->assetBuckets - 1);
+			a->nextDigest = c->digests[h];
+			c->digests[h] = a;
+		}
+		while ((a = oldResources[i])) {
+			oldResources[i] = a->nextResource;
+			h = cachePointerHash(a->resource) & (c->assetBuckets - 1);
+			a->nextResource = c->resources[h];
+			c->resources[h] = a;
+		}
+	}
+	free(oldDigests);
+	free(oldResources);
+}
+
+static void cacheUnlink(struct cache *c, struct cacheasset *a)
+{
+	if (a->newer)
+		a->newer->older = a->older;
+	else
+		c->newest = a->older;
+	if (a->older)
+		a->older->newer = a->newer;
+	else
+		c->oldest = a->newer;
+	a->newer = a->older = NULL;
+}
+
+static void cacheLink(struct cache *c, struct cacheasset *a)
+{
+	a->newer = NULL;
+	a->older = c->newest;
+	if (c->newest)
+		c->newest->newer = a;
+	else
+		c->oldest = a;
+	c->newest = a;
+}
+
+static void cacheAcquire(struct cache *c, struct cacheasset *a)
+{
+	if (!a->refs++)
+		cacheUnlink(c, a);
+}
+
+static void cacheAddName(struct cache *c, struct pack *p, const char *name, struct cacheasset *a)
+{
+	struct cachename *n;
+	unsigned int h;
+
+	if (c->numNames + 1 > c->nameBuckets)
+		cacheGrowNames(c);
+	sgeNew(n, struct cachename);
+	n->pack = p;
+	n->name = strdup(name);
+	n->asset = a;
+	n->sibling = a->names;
+	a->names = n;
+	h = cacheNameHash(p, name) & (c->nameBuckets - 1);
+	n->next = c->names[h];
+	c->names[h] = n;
+	c->numNames++;
+}
+
+static struct cachename *cacheFindName(struct cache *c, struct pack *p, const char *name)
+{
+	struct cachename *n;
+
+	for (n = c->names[cacheNameHash(p, name) & (c->nameBuckets - 1)]; n; n = n->next) {
+		if (n->pack == p && !strcmp(n->name, name))
+			break;
+	}
+	return n;
+}
+
+static struct cacheasset *cacheFindDigest(struct cache *c, int type, const char *digest)
+{
+	struct cacheasset *a;
+
+	for (a = c->digests[cacheDigestHash(type, digest) & (c->assetBuckets - 1)]; a; a = a->nextDigest) {
+		if (a->type == type && !strcmp(a->digest, digest))
+			break;
+	}
+	return a;
+}
+
+static struct cacheasset *cacheFindResource(struct cache *c, const void *resource)
+{
+	struct cacheasset *a;
+
+	for (a = c->resources[cachePointerHash(resource) & (c->assetBuckets - 1)]; a; a = a->nextResource) {
+		if (a->resource == resource)
+			break;
+	}
+	return a;
+}
+
+static void cacheFreeAsset(struct cache *c, struct cacheasset *a)
+{
+	struct cacheasset **link;
+	struct cachename **nameLink, *n;
+
+	if (!a->refs)
+		cacheUnlink(c, a);
+	for (link = &c->resources[cachePointerHash(a->resource) & (c->assetBuckets - 1)]; *link != a; link = &(*link)->nextResource)
+		;
+	*link = a->nextResource;
+	if (a->digest) {
+		for (link = &c->digests[cacheDigestHash(a->type, a->digest) & (c->assetBuckets - 1)]; *link != a; link = &(*link)->nextDigest)
+			;
+		*link = a->nextDigest;
+	}
+	while ((n = a->names)) {
+		a->names = n->sibling;
+		for (nameLink = &c->names[cacheNameHash(n->pack, n->name) & (c->nameBuckets - 1)]; *nameLink != n; nameLink = &(*nameLink)->next)
+			;
+		*nameLink = n->next;
+		c->numNames--;
+		free(n->name);
+		free(n);
+	}
+	if (a->type == CACHE_IMAGE)
+		SDL_FreeSurface(a->resource);
+	else
+		Mix_FreeChunk(a->resource);
+	c->used -= a->bytes;
+	c->numAssets--;
+	sgeFree(a->digest);
+	free(a);
+}
+
+static void cacheEvict(struct cache *c)
+{
+	while (c->used > c->budget && c->oldest) {
+		cacheFreeAsset(c, c->oldest);
+		c->evictions++;
+	}
+}
+
+static void *cacheDecode(int type, const void *data, Uint32 size, Uint32 *bytes)
+{
+	SDL_Surface *loaded, *image;
+	Mix_Chunk *sound;
+
+	if (type == CACHE_SOUND) {
+		sound = Mix_LoadWAV_RW(SDL_RWFromConstMem(data, size), 1);
+		if (sound)
+			*bytes = sizeof(Mix_Chunk) + sound->alen;
+		return sound;
+	}
+	loaded = IMG_Load_RW(SDL_RWFromConstMem(data, size), 1);
+	if (!loaded)
+		return NULL;
+	image = SDL_DisplayFormatAlpha(loaded);
+	SDL_FreeSurface(loaded);
+	if (image)
+		*bytes = sizeof(SDL_Surface) + image->pitch * image->h;
+	return image;
+}
+
+static void *cacheLoad(struct cache *c, int type, struct pack *p, const char *name)
+{
+	struct cachename *n;
+	struct cacheasset *a;
+	const void *data;
+	char *digest = NULL;
+	void *resource;
+	Uint32 size, bytes = 0;
+	unsigned int h;
+
+	n = cacheFindName(c, p, name);
+	if (n) {
+		if (n->asset->type != type)
+			return NULL;
+		c->hits++;
+		cacheAcquire(c, n->asset);
+		return n->asset->resource;
+	}
+
+	data = packRead(p, name, &size);
+	if (!data)
+		return NULL;
+	if (c->flags & CACHE_DEDUP) {
+		digest = sgeSHA1(data, size);
+		a = cacheFindDigest(c, type, digest);
+		if (a) {
+			packRelease(p, data);
+			sgeFree(digest);
+			c->shared++;
+			cacheAddName(c, p, name, a);
+			cacheAcquire(c, a);
+			return a->resource;
+		}
+	}
+	c->misses++;
+	resource = cacheDecode(type, data, size, &bytes);
+	packRelease(p, data);
+	if (!resource) {
+		sgeFree(digest);
+		return NULL;
+	}
+
+	if (c->numAssets + 1 > c->assetBuckets)
+		cacheGrowAssets(c);
+	sgeNew(a, struct cacheasset);
+	a->type = type;
+	a->resource = resource;
+	a->digest = digest;
+	a->bytes = bytes;
+	a->refs = 1;
+	h = cachePointerHash(resource) & (c->assetBuckets - 1);
+	a->nextResource = c->resources[h];
+	c->resources[h] = a;
+	if (digest) {
+		h = cacheDigestHash(type, digest) & (c->assetBuckets - 1);
+		a->nextDigest = c->digests[h];
+		c->digests[h] = a;
+	}
+	c->numAssets++;
+	cacheAddName(c, p, name, a);
+	c->used += bytes;
+	cacheEvict(c);
+	return resource;
+}
+
+void cacheInit(struct cache *c, Uint32 budget, int flags)
+{
+	memset(c, 0, sizeof(*c));
+	c->budget = budget;
+	c->flags = flags;
+	cacheGrowNames(c);
+	cacheGrowAssets(c);
+}
+
+void cacheDestroy(struct cache *c)
+{
+	unsigned int i;
+
+	for (i = 0; i < c->assetBuckets; i++) {
+		while (c->resources[i])
+			cacheFreeAsset(c, c->resources[i]);
+	}
+	sgeFree(c->names);
+	sgeFree(c->digests);
+	sgeFree(c->resources);
+	c->nameBuckets = c->assetBuckets = 0;
+}
+
+void cacheForgetPack(struct cache *c, struct pack *p)
+{
+	struct cachename **link, **siblingLink, *n;
+	struct cacheasset *a;
+	unsigned int i;
+
+	for (i = 0; i < c->nameBuckets; i++) {
+		for (link = &c->names[i]; (n = *link); ) {
+			if (n->pack != p) {
+				link = &n->next;
+				continue;
+			}
+			*link = n->next;
+			a = n->asset;
+			for (siblingLink = &a->names; *siblingLink != n; siblingLink = &(*siblingLink)->sibling)
+				;
+			*siblingLink = n->sibling;
+			c->numNames--;
+			free(n->name);
+			free(n);
+			// nothing can ask for it by name any more
+			if (!a->names && !a->refs)
+				cacheFreeAsset(c, a);
+		}
+	}
+}
+
+void cacheSetBudget(struct cache *c, Uint32 budget)
+{
+	c->budget = budget;
+	cacheEvict(c);
+}
+
+SDL_Surface *cacheImage(struct cache *c, struct pack *p, const char *name)
+{
+	return cacheLoad(c, CACHE_IMAGE, p, name);
+}
+
+Mix_Chunk *cacheSound(struct cache *c, struct pack *p, const char *name)
+{
+	return cacheLoad(c, CACHE_SOUND, p, name);
+}
+
+void cacheRelease(struct cache *c, const void *resource)
+{
+	struct cacheasset *a = cacheFindResource(c, resource);
+
+	if (!a || !a->refs) {
+		fprintf(stderr, "%s\n", "released a resource the cache does not hold");
+		return;
+	}
+	if (!--a->refs) {
+		cacheLink(c, a);
+		cacheEvict(c);
+	}
+}
@@ -0,0 +1,62 @@
+#ifndef _CACHE_H
+#define _CACHE_H
+
+#include <sge.h>
+#include "pack.h"
+
+// cacheInit() flags
+#define CACHE_DEDUP 1
+
+#define CACHE_IMAGE 0
+#define CACHE_SOUND 1
+
+/*
+ * Shared, reference counted images and sounds. Asking for the same entry
+ * of the same pack again returns the same surface or chunk, each request
+ * must be matched by a cacheRelease(). With CACHE_DEDUP the raw entry is
+ * also hashed with sgeSHA1() on its first load, equal files stored under
+ * different names then share one decoded copy.
+ *
+ * Entries nobody references stay cached and are evicted least recently
+ * released first while the cache is over its budget of bytes. Referenced
+ * entries are never evicted, the budget may be exceeded by them.
+ *
+ * Entries are keyed by the pack pointer, so a pack must be forgotten with
+ * cacheForgetPack() before packClose(), or a later packOpen() that gets
+ * the same address would be served the old archive's entries. Surfaces
+ * and sounds still referenced stay valid until they are released.
+ *
+ * sge objects free the surfaces they are given; pass them a cached
+ * surface only after taking an SDL reference with surface->refcount++.
+ */
+struct cacheasset;
+struct cachename;
+
+struct cache {
+	Uint32 budget;
+	Uint32 used;
+	int flags;
+	// entries by (pack, name), by content digest and by resource pointer
+	struct cachename **names;
+	struct cacheasset **digests, **resources;
+	unsigned int numNames, nameBuckets;
+	unsigned int numAssets, assetBuckets;
+	// unreferenced assets, the oldest is evicted first
+	struct cacheasset *newest, *oldest;
+	// statistics
+	Uint32 hits, shared, misses, evictions;
+};
+
+void cacheInit(struct cache *c, Uint32 budget, int flags);
+// frees every entry, references or not
+void cacheDestroy(struct cache *c);
+void cacheSetBudget(struct cache *c, Uint32 budget);
+// drops every name looked up in p, call it before packClose(p)
+void cacheForgetPack(struct cache *c, struct pack *p);
+
+// NULL if there is no such entry or it can't be decoded
+SDL_Surface *cacheImage(struct cache *c, struct pack *p, const char *name);
+Mix_Chunk *cacheSound(struct cache *c, struct pack *p, const char *name);
+void cacheRelease(struct cache *c, const void *resource);
+
+#endif
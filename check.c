@@ -0,0 +1,353 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <sge.h>
+#include "lz.h"
+#include "pack.h"
+
+// scratch files live here and are removed again
+#define CHECKDIR "/tmp/space-terraria-check-XXXXXX"
+#define CHECKKEY "spaaaace"
+#define CHECKNAMELEN 64
+
+struct checkfile {
+	const char *name;
+	Uint32 size;
+	// 0 fills with noise, otherwise repeats the text
+	const char *text;
+	char path[CHECKNAMELEN];
+	Uint8 *data;
+};
+
+static struct checkfile files[] = {
+	{"empty", 0, NULL, "", NULL},
+	{"byte", 1, NULL, "", NULL},
+	{"text", 100000, "Terraria ... in ... SPAAAAAAACE!!! ", "", NULL},
+	{"noise", 70000, NULL, "", NULL},
+	// stays over CIPHER_PARALLEL after compression
+	{"large", 3 << 20, NULL, "", NULL},
+};
+#define NUMFILES (sizeof(files) / sizeof(files[0]))
+
+// around the token nibble, the first length byte and the 64k window
+static const Uint32 lzSizes[] = {0, 1, 3, 4, 5, 15, 16, 19, 20, 270, 271, 65535, 65536, 65537, 200000};
+#define NUMLZSIZES (sizeof(lzSizes) / sizeof(lzSizes[0]))
+
+// RFC 7539 2.4.2: key 00 01 .. 1f, nonce 00 00 00 00 00 00 00 4a 00 00 00 00,
+// counter 1
+static const char *rfcPlain = "Ladies and Gentlemen of the class of '99: "
+	"If I could offer you only one tip for the future, sunscreen would be it.";
+static const Uint8 rfcCipher[] = {
+	0x6e, 0x2e, 0x35, 0x9a, 0x25, 0x68, 0xf9, 0x80, 0x41, 0xba, 0x07, 0x28, 0xdd, 0x0d, 0x69, 0x81,
+	0xe9, 0x7e, 0x7a, 0xec, 0x1d, 0x43, 0x60, 0xc2, 0x0a, 0x27, 0xaf, 0xcc, 0xfd, 0x9f, 0xae, 0x0b,
+	0xf9, 0x1b, 0x65, 0xc5, 0x52, 0x47, 0x33, 0xab, 0x8f, 0x59, 0x3d, 0xab, 0xcd, 0x62, 0xb3, 0x57,
+	0x16, 0x39, 0xd6, 0x24, 0xe6, 0x51, 0x52, 0xab, 0x8f, 0x53, 0x0c, 0x35, 0x9f, 0x08, 0x61, 0xd8,
+	0x07, 0xca, 0x0d, 0xbf, 0x50, 0x0d, 0x6a, 0x61, 0x56, 0xa3, 0x8e, 0x08, 0x8a, 0x22, 0xb6, 0x5e,
+	0x52, 0xbc, 0x51, 0x4d, 0x16, 0xcc, 0xf8, 0x06, 0x81, 0x8c, 0xe9, 0x1a, 0xb7, 0x79, 0x37, 0x36,
+	0x5a, 0xf9, 0x0b, 0xbf, 0x74, 0xa3, 0x5b, 0xe6, 0xb4, 0x0b, 0x8e, 0xed, 0xf2, 0x78, 0x5e, 0x42,
+	0x87, 0x4d,
+};
+
+static char dir[] = CHECKDIR;
+static char archive[CHECKNAMELEN];
+static int failures = 0;
+
+static int check(int ok, const char *format, ...)
+{
+	va_list args;
+
+	va_start(args, format);
+	vprintf(format, args);
+	va_end(args);
+	printf("%s\n", ok ? " ok" : " FAILED");
+	failures += !ok;
+	return ok;
+}
+
+// xorshift, the same bytes on every run
+static Uint32 checkRandom(void)
+{
+	static Uint32 state = 0x12345678;
+
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+	return state;
+}
+
+static void checkFill(Uint8 *data, Uint32 size, const char *text)
+{
+	Uint32 i;
+
+	for (i = 0; i < size; i++)
+		data[i] = text ? text[i % strlen(text)] : checkRandom() >> 24;
+}
+
+static int checkWriteFiles(void)
+{
+	struct checkfile *c;
+	FILE *f;
+	Uint32 i;
+	int ok;
+
+	if (!mkdtemp(dir))
+		return 0;
+	snprintf(archive, CHECKNAMELEN, "%s/archive.d", dir);
+	for (i = 0; i < NUMFILES; i++) {
+		c = &files[i];
+		snprintf(c->path, CHECKNAMELEN, "%s/%s", dir, c->name);
+		sgeMallocNoInit(c->data, Uint8, c->size + 1);
+		checkFill(c->data, c->size, c->text);
+		f = fopen(c->path, "wb");
+		if (!f)
+			return 0;
+		ok = !c->size || fwrite(c->data, c->size, 1, f) == 1;
+		if (fclose(f) || !ok)
+			return 0;
+	}
+	return 1;
+}
+
+static void checkRemoveFiles(void)
+{
+	Uint32 i;
+
+	for (i = 0; i < NUMFILES; i++) {
+		unlink(files[i].path);
+		free(files[i].data);
+	}
+	unlink(archive);
+	rmdir(dir);
+}
+
+// the last four bytes of the archive
+static int checkMarker(char marker[5])
+{
+	FILE *f = fopen(archive, "rb");
+	int ok;
+
+	memset(marker, 0, 5);
+	if (!f)
+		return 0;
+	ok = !fseek(f, -4, SEEK_END) && fread(marker, 4, 1, f) == 1;
+	fclose(f);
+	return ok;
+}
+
+// every entry read back through pack.h must match the file it came from
+static void checkArchive(const char *key, int flags, const char *expected)
+{
+	char *names[NUMFILES];
+	char marker[5];
+	struct pack *p;
+	const void *data;
+	Uint32 i, size;
+	int same, index;
+
+	for (i = 0; i < NUMFILES; i++)
+		names[i] = files[i].path;
+	if (!check(packCreate(archive, names, NUMFILES, key, flags), "packCreate key %s flags %d", key ? key : "none", flags))
+		return;
+	if (!checkMarker(marker))
+		marker[0] = 0;
+	if (expected)
+		check(!strcmp(marker, expected), "  marker %s", expected);
+	else
+		check(strcmp(marker, "PAK2") && strcmp(marker, "PAK3"), "  no marker");
+
+	p = packOpen(archive, key);
+	if (!check(p != NULL, "  packOpen"))
+		return;
+	for (i = 0; i < NUMFILES; i++) {
+		data = packRead(p, files[i].path, &size);
+		same = data && size == files[i].size && !memcmp(data, files[i].data, size);
+		check(same, "  packRead %s", files[i].name);
+		if (data)
+			packRelease(p, data);
+		if ((index = packFind(p, files[i].path)) < 0)
+			continue;
+		if ((flags & PACK_COMPRESS) && files[i].text)
+			check(p->entries[index].flags & PACK_LZ, "  %s stored compressed", files[i].name);
+		if ((flags & PACK_CIPHER) && files[i].size)
+			check(p->entries[index].flags & PACK_CHACHA, "  %s encrypted with chacha20", files[i].name);
+	}
+	packClose(p);
+	if (key)
+		check(packOpen(archive, "wrong") == NULL, "  wrong key refused");
+}
+
+// two archives with the same key and contents must not share a keystream
+static void checkSalt(void)
+{
+	char *names[1] = {files[1].path};
+	Uint32 salt[2] = {0, 0};
+	struct pack *p;
+	int i;
+
+	for (i = 0; i < 2; i++) {
+		if (!packCreate(archive, names, 1, CHECKKEY, PACK_CIPHER) || !(p = packOpen(archive, CHECKKEY))) {
+			check(0, "salt archive %d", i);
+			return;
+		}
+		if (i)
+			check(p->salt[0] != salt[0] || p->salt[1] != salt[1], "salt differs between archives");
+		salt[0] = p->salt[0];
+		salt[1] = p->salt[1];
+		packClose(p);
+	}
+}
+
+// keyed archives without flags must stay readable by libsge itself,
+// which can't open an archive without a key or read an empty entry
+static void checkLegacy(const char *key)
+{
+	SGEFILE *f;
+	void *data;
+	Uint32 i, size;
+	int same;
+
+	checkArchive(key, 0, NULL);
+	if (!key)
+		return;
+	f = sgeOpenFile(archive, key);
+	if (!check(f != NULL, "  sgeOpenFile"))
+		return;
+	for (i = 0; i < NUMFILES; i++) {
+		if (!files[i].size)
+			continue;
+		size = sgeGetFileSize(f, files[i].path);
+		data = sgeReadFile(f, files[i].path);
+		same = data && size == files[i].size && !memcmp(data, files[i].data, size);
+		check(same, "  sgeReadFile %s", files[i].name);
+		free(data);
+	}
+	sgeCloseFile(f);
+}
+
+// one buffer through lzCompress() and back, then damaged on purpose
+static void checkLz(Uint32 size, const char *text)
+{
+	Uint32 capacity = size + size / 255 + 16, stored;
+	Uint8 *src, *packed, *out;
+	int ok;
+
+	sgeMallocNoInit(src, Uint8, size + 1);
+	sgeMallocNoInit(packed, Uint8, capacity);
+	sgeMallocNoInit(out, Uint8, size + 1);
+	checkFill(src, size, text);
+	stored = lzCompress(src, size, packed, capacity);
+	ok = stored && lzDecompress(packed, stored, out, size) && !memcmp(out, src, size);
+	if (check(ok, "lz %u bytes of %s", size, text ? text : "noise") && size) {
+		check(!lzCompress(src, size, packed, stored - 1), "  one byte less room fails");
+		check(!lzDecompress(packed, stored / 2, out, size), "  truncated input fails");
+		check(!lzDecompress(packed, stored, out, size - 1), "  shorter output fails");
+	}
+	free(src);
+	free(packed);
+	free(out);
+}
+
+// a block of noise repeated exactly at the largest offset, or just beyond
+// it, with a run in between that leaves the block's hash slots alone
+static void checkLzWindow(Uint32 distance)
+{
+	Uint32 block = 1000, size = distance + block, capacity = size + size / 255 + 16, stored, i;
+	Uint8 *src, *packed, *out;
+	int ok;
+
+	sgeMallocNoInit(src, Uint8, size);
+	sgeMallocNoInit(packed, Uint8, capacity);
+	sgeMallocNoInit(out, Uint8, size);
+	checkFill(src, block, NULL);
+	checkFill(src + block, distance - block, "a");
+	for (i = distance; i < size; i++)
+		src[i] = src[i - distance];
+	stored = lzCompress(src, size, packed, capacity);
+	ok = stored && lzDecompress(packed, stored, out, size) && !memcmp(out, src, size);
+	check(ok, "lz repeat at distance %u", distance);
+	if (distance <= 0xFFFF)
+		check(stored < block * 3 / 2, "  found the repeat");
+	else
+		check(stored > block * 2, "  no match beyond the window");
+	free(src);
+	free(packed);
+	free(out);
+}
+
+static void checkChaCha(void)
+{
+	static const Uint32 nonce[3] = {0, 0x4a000000, 0};
+	Uint8 data[64 + sizeof(rfcCipher)];
+	struct cipher c;
+	int i;
+
+	// key bytes are read as little endian words, like cipherInit() does
+	for (i = 0; i < 32; i++)
+		((Uint8 *)c.key)[i] = i;
+	for (i = 0; i < 8; i++)
+		c.key[i] = sgeByteSwap32(c.key[i]);
+	// cipherApply() starts at block 0 and the vector at block 1
+	memset(data, 0, 64);
+	memcpy(data + 64, rfcPlain, sizeof(rfcCipher));
+	cipherApply(&c, nonce, data, sizeof(data));
+	check(!memcmp(data + 64, rfcCipher, sizeof(rfcCipher)), "chacha20 rfc 7539 2.4.2");
+}
+
+// the threaded path must produce the same keystream as a single thread
+static void checkChaChaThreads(void)
+{
+	static const Uint32 nonce[3] = {1, 2, 3};
+	Uint32 length = CIPHER_PARALLEL + 1001;
+	Uint8 *single, *threaded;
+	struct cipher c;
+
+	cipherInit(&c, CHECKKEY);
+	sgeMalloc(single, Uint8, length);
+	sgeMalloc(threaded, Uint8, length);
+	cipherApply(&c, nonce, single, CIPHER_PARALLEL - 1);
+	cipherApply(&c, nonce, threaded, length);
+	check(!memcmp(single, threaded, CIPHER_PARALLEL - 1), "chacha20 over %d threads", CIPHER_THREADS);
+	cipherApply(&c, nonce, threaded, length);
+	memset(single, 0, length);
+	check(!memcmp(single, threaded, length), "  applied twice is a no-op");
+	free(single);
+	free(threaded);
+}
+
+/*
+ * Round trips the archive formats through packCreate() and packRead(),
+ * the LZ codec through buffers of awkward sizes, and checks ChaCha20
+ * against the RFC 7539 test vector.
+ * Usage: check
+ * Prints one line per check, the exit code is the number of failures.
+ */
+int run(int argc, char **argv)
+{
+	Uint32 i;
+
+	for (i = 0; i < NUMLZSIZES; i++) {
+		checkLz(lzSizes[i], NULL);
+		checkLz(lzSizes[i], "a");
+		checkLz(lzSizes[i], files[2].text);
+	}
+	checkLzWindow(0xFFFF);
+	checkLzWindow(0x10000);
+	checkChaCha();
+	checkChaChaThreads();
+
+	if (!checkWriteFiles())
+		sgeBailOut("could not write the scratch files to %s\n", dir);
+
+	checkLegacy(NULL);
+	checkLegacy(CHECKKEY);
+	checkArchive(NULL, PACK_COMPRESS, "PAK2");
+	checkArchive(CHECKKEY, PACK_COMPRESS, "PAK2");
+	checkArchive(CHECKKEY, PACK_CIPHER, "PAK3");
+	checkArchive(CHECKKEY, PACK_COMPRESS | PACK_CIPHER, "PAK3");
+	checkSalt();
+
+	checkRemoveFiles();
+	printf("%d failed\n", failures);
+	return failures;
+}
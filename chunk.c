@@ -0,0 +1,296 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <sge.h>
+#include "chunk.h"
+
+#define STORE_INITIAL_CAPACITY 64
+#define CHUNK_BLOCKS (CHUNKSIZE * CHUNKSIZE)
+
+static int chunkBitsFor(int paletteSize)
+{
+	if (paletteSize <= 1)
+		return 0;
+	if (paletteSize <= 2)
+		return 1;
+	if (paletteSize <= 4)
+		return 2;
+	if (paletteSize <= 16)
+		return 4;
+	return 8;
+}
+
+static inline int chunkIndex(struct chunkblocks *b, int i)
+{
+	int bit = i * b->bits;
+	return (b->indices[bit >> 3] >> (bit & 7)) & ((1 << b->bits) - 1);
+}
+
+static inline void chunkSetIndex(struct chunkblocks *b, int i, int index)
+{
+	int bit = i * b->bits;
+	int mask = ((1 << b->bits) - 1) << (bit & 7);
+	b->indices[bit >> 3] = (b->indices[bit >> 3] & ~mask) | (index << (bit & 7));
+}
+
+void chunkInitBlocks(struct chunk *c, int type)
+{
+	c->blocks.bits = 0;
+	c->blocks.paletteSize = 1;
+	c->blocks.uniform = type;
+	c->blocks.palette = NULL;
+	c->blocks.indices = NULL;
+	c->redraw = 1;
+}
+
+void chunkFreeBlocks(struct chunk *c)
+{
+	sgeFree(c->blocks.palette);
+	sgeFree(c->blocks.indices);
+	chunkInitBlocks(c, 0);
+}
+
+int chunkGetBlock(struct chunk *c, int x, int y)
+{
+	if (!c->blocks.bits)
+		return c->blocks.uniform;
+	return c->blocks.palette[chunkIndex(&c->blocks, y * CHUNKSIZE + x)];
+}
+
+void chunkGetBlocks(struct chunk *c, unsigned char *types)
+{
+	int i;
+
+	if (!c->blocks.bits) {
+		memset(types, c->blocks.uniform, CHUNK_BLOCKS);
+		return;
+	}
+	for (i = 0; i < CHUNK_BLOCKS; i++)
+		types[i] = c->blocks.palette[chunkIndex(&c->blocks, i)];
+}
+
+void chunkSetBlocks(struct chunk *c, const unsigned char *types)
+{
+	unsigned char palette[256];
+	short lookup[256];
+	int paletteSize = 0;
+	int i;
+
+	memset(lookup, -1, sizeof(lookup));
+	for (i = 0; i < CHUNK_BLOCKS; i++) {
+		if (lookup[types[i]] < 0) {
+			lookup[types[i]] = paletteSize;
+			palette[paletteSize++] = types[i];
+		}
+	}
+
+	chunkFreeBlocks(c);
+	if (paletteSize == 1) {
+		chunkInitBlocks(c, types[0]);
+		return;
+	}
+	c->blocks.bits = chunkBitsFor(paletteSize);
+	c->blocks.paletteSize = paletteSize;
+	sgeMallocNoInit(c->blocks.palette, unsigned char, (1 << c->blocks.bits));
+	memcpy(c->blocks.palette, palette, paletteSize);
+	sgeMalloc(c->blocks.indices, unsigned char, (CHUNK_BLOCKS * c->blocks.bits + 7) / 8);
+	for (i = 0; i < CHUNK_BLOCKS; i++)
+		chunkSetIndex(&c->blocks, i, lookup[types[i]]);
+}
+
+void chunkSetBlock(struct chunk *c, int x, int y, int type)
+{
+	unsigned char types[CHUNK_BLOCKS];
+	int index;
+
+	for (index = 0; index < c->blocks.paletteSize; index++) {
+		if ((c->blocks.bits ? c->blocks.palette[index] : c->blocks.uniform) == type)
+			break;
+	}
+	if (index == c->blocks.paletteSize && index == 1 << c->blocks.bits) {
+		// the palette is full, repack at the next width
+		chunkGetBlocks(c, types);
+		types[y * CHUNKSIZE + x] = type;
+		chunkSetBlocks(c, types);
+		c->dirty = 1;
+		return;
+	}
+	if (!c->blocks.bits)
+		return;
+	if (index == c->blocks.paletteSize)
+		c->blocks.palette[c->blocks.paletteSize++] = type;
+	chunkSetIndex(&c->blocks, y * CHUNKSIZE + x, index);
+	c->redraw = 1;
+	c->dirty = 1;
+}
+
+static unsigned int chunkHash(int x, int y)
+{
+	uint32_t h = (uint32_t)x * 0x9E3779B1u ^ (uint32_t)y * 0x85EBCA77u;
+	h ^= h >> 16;
+	h *= 0x7FEB352Du;
+	h ^= h >> 15;
+	return h;
+}
+
+static unsigned int chunkStoreFind(struct chunkstore *store, int x, int y)
+{
+	unsigned int mask = store->capacity - 1;
+	unsigned int i = chunkHash(x, y) & mask;
+	struct chunk *c;
+
+	while ((c = store->slots[i])) {
+		if (c->myX == x && c->myY == y)
+			break;
+		i = (i + 1) & mask;
+	}
+	return i;
+}
+
+static void chunkStoreGrow(struct chunkstore *store)
+{
+	struct chunk **old = store->slots;
+	unsigned int oldCapacity = store->capacity;
+	unsigned int i;
+
+	store->capacity = oldCapacity ? oldCapacity * 2 : STORE_INITIAL_CAPACITY;
+	sgeMalloc(store->slots, struct chunk *, store->capacity);
+	for (i = 0; i < oldCapacity; i++) {
+		if (old[i])
+			store->slots[chunkStoreFind(store, old[i]->myX, old[i]->myY)] = old[i];
+	}
+	free(old);
+}
+
+static void chunkStoreUnlink(struct chunkstore *store, struct chunk *c)
+{
+	if (c->newer)
+		c->newer->older = c->older;
+	else
+		store->newest = c->older;
+	if (c->older)
+		c->older->newer = c->newer;
+	else
+		store->oldest = c->newer;
+	c->newer = c->older = NULL;
+}
+
+static void chunkStoreLink(struct chunkstore *store, struct chunk *c)
+{
+	c->newer = NULL;
+	c->older = store->newest;
+	if (store->newest)
+		store->newest->newer = c;
+	else
+		store->oldest = c;
+	store->newest = c;
+}
+
+void chunkStoreInit(struct chunkstore *store)
+{
+	store->slots = NULL;
+	store->capacity = 0;
+	store->count = 0;
+	store->newest = NULL;
+	store->oldest = NULL;
+	chunkStoreGrow(store);
+}
+
+void chunkStoreDestroy(struct chunkstore *store)
+{
+	sgeFree(store->slots);
+	store->capacity = 0;
+	store->count = 0;
+	store->newest = NULL;
+	store->oldest = NULL;
+}
+
+struct chunk *chunkStoreGet(struct chunkstore *store, int x, int y)
+{
+	return store->slots[chunkStoreFind(store, x, y)];
+}
+
+void chunkStoreInsert(struct chunkstore *store, struct chunk *c)
+{
+	unsigned int i;
+
+	// keep the load factor at or below one half so probe runs stay short
+	if ((store->count + 1) * 2 > store->capacity)
+		chunkStoreGrow(store);
+	i = chunkStoreFind(store, c->myX, c->myY);
+	if (store->slots[i] == c) {
+		chunkStoreTouch(store, c);
+		return;
+	}
+	if (store->slots[i])
+		chunkStoreUnlink(store, store->slots[i]);
+	else
+		store->count++;
+	store->slots[i] = c;
+	chunkStoreLink(store, c);
+}
+
+struct chunk *chunkStoreRemove(struct chunkstore *store, int x, int y)
+{
+	unsigned int mask = store->capacity - 1;
+	unsigned int i = chunkStoreFind(store, x, y);
+	unsigned int j, home;
+	struct chunk *removed = store->slots[i];
+
+	if (!removed)
+		return NULL;
+	chunkStoreUnlink(store, removed);
+
+	// backward shift deletion, no tombstones needed
+	store->slots[i] = NULL;
+	store->count--;
+	j = i;
+	for (;;) {
+		j = (j + 1) & mask;
+		if (!store->slots[j])
+			break;
+		home = chunkHash(store->slots[j]->myX, store->slots[j]->myY) & mask;
+		if (((j - home) & mask) >= ((j - i) & mask)) {
+			store->slots[i] = store->slots[j];
+			store->slots[j] = NULL;
+			i = j;
+		}
+	}
+	return removed;
+}
+
+void chunkStoreTouch(struct chunkstore *store, struct chunk *c)
+{
+	if (store->newest == c)
+		return;
+	chunkStoreUnlink(store, c);
+	chunkStoreLink(store, c);
+}
+
+struct chunk *chunkStoreOldest(struct chunkstore *store)
+{
+	return store->oldest;
+}
+
+void chunkStoreForEachIn(struct chunkstore *store, int x0, int y0, int x1, int y1, void (*fn)(struct chunk *c, void *data), void *data)
+{
+	struct chunk *c;
+	int x, y;
+
+	for (y = y0; y <= y1; y++) {
+		for (x = x0; x <= x1; x++) {
+			if ((c = chunkStoreGet(store, x, y)))
+				fn(c, data);
+		}
+	}
+}
+
+void chunkStoreForEach(struct chunkstore *store, void (*fn)(struct chunk *c, void *data), void *data)
+{
+	unsigned int i;
+
+	for (i = 0; i < store->capacity; i++) {
+		if (store->slots[i])
+			fn(store->slots[i], data);
+	}
+}
@@ -0,0 +1,81 @@
+#ifndef _CHUNK_H
+#define _CHUNK_H
+
+#define CHUNKSIZE 10
+
+// chunk states, only ever changed by the main thread
+#define CHUNK_QUEUED 0
+#define CHUNK_READY 2
+
+/*
+ * Block types are stored as indices into a per chunk palette, packed at
+ * 1, 2, 4 or 8 bits per block depending on the palette size. Chunks made
+ * of a single block type keep no index array at all (bits == 0), so an
+ * all air chunk costs only the struct itself.
+ */
+struct chunkblocks {
+	unsigned char bits;
+	unsigned short paletteSize;
+	unsigned char uniform;
+	unsigned char *palette;
+	unsigned char *indices;
+};
+
+struct SDL_Surface;
+
+struct chunk {
+	int myX, myY;
+	// CHUNK_QUEUED from creation until genCollect() hands it back
+	int state;
+	struct chunkblocks blocks;
+	// pre-rendered blocks, redrawn by the renderer when redraw is set
+	struct SDL_Surface *surface;
+	int redraw;
+	// blocks changed since the chunk was generated, loaded or saved
+	int dirty;
+	// link for the generator queues and the finished list, see gen.h
+	struct chunk *next;
+	// least recently used order, maintained by the chunk store
+	struct chunk *newer, *older;
+};
+
+// setting blocks marks the chunk for redraw, chunkSetBlock() also marks it dirty
+void chunkInitBlocks(struct chunk *c, int type);
+void chunkFreeBlocks(struct chunk *c);
+int chunkGetBlock(struct chunk *c, int x, int y);
+void chunkSetBlock(struct chunk *c, int x, int y, int type);
+// bulk access to all blocks as a row major CHUNKSIZE * CHUNKSIZE array
+void chunkSetBlocks(struct chunk *c, const unsigned char *types);
+void chunkGetBlocks(struct chunk *c, unsigned char *types);
+
+/*
+ * Open addressing hash map from (chunkX, chunkY) to chunks, linear probing
+ * over a power of two table. Lookups, inserts and removals are O(1) no
+ * matter how much of the world has been explored.
+ *
+ * The store also keeps its chunks in least recently used order, inserted
+ * and touched chunks become the newest, chunkStoreOldest() is the first
+ * candidate for eviction.
+ */
+struct chunkstore {
+	struct chunk **slots;
+	unsigned int capacity;
+	unsigned int count;
+	struct chunk *newest, *oldest;
+};
+
+void chunkStoreInit(struct chunkstore *store);
+void chunkStoreDestroy(struct chunkstore *store);
+
+struct chunk *chunkStoreGet(struct chunkstore *store, int x, int y);
+void chunkStoreInsert(struct chunkstore *store, struct chunk *c);
+struct chunk *chunkStoreRemove(struct chunkstore *store, int x, int y);
+
+void chunkStoreTouch(struct chunkstore *store, struct chunk *c);
+struct chunk *chunkStoreOldest(struct chunkstore *store);
+
+// calls fn for every chunk present in the rectangle [x0, x1] x [y0, y1]
+void chunkStoreForEachIn(struct chunkstore *store, int x0, int y0, int x1, int y1, void (*fn)(struct chunk *c, void *data), void *data);
+void chunkStoreForEach(struct chunkstore *store, void (*fn)(struct chunk *c, void *data), void *data);
+
+#endif
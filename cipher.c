@@ -0,0 +1,136 @@
+#include "cipher.h"
+
+typedef Uint32 cipherv4 __attribute__((vector_size(16)));
+
+struct cipherjob {
+	struct cipher *c;
+	const Uint32 *nonce;
+	Uint32 counter;
+	Uint8 *data;
+	Uint32 length;
+};
+
+#define ROTATE(v, n) ((v) << (n) | (v) >> (32 - (n)))
+#define QUARTER(a, b, c, d) do { \
+	a += b; d ^= a; d = ROTATE(d, 16); \
+	c += d; b ^= c; b = ROTATE(b, 12); \
+	a += b; d ^= a; d = ROTATE(d, 8); \
+	c += d; b ^= c; b = ROTATE(b, 7); \
+} while (0)
+
+static const Uint32 sigma[4] = {0x61707865, 0x3320646e, 0x79622d32, 0x6b206574};
+
+// four keystream blocks starting at counter, block j in lane j
+static void cipherBlocks(const Uint32 key[8], const Uint32 nonce[3], Uint32 counter, Uint32 out[4][16])
+{
+	cipherv4 s[16], x[16];
+	int i, j;
+
+	for (i = 0; i < 4; i++)
+		s[i] = (cipherv4){sigma[i], sigma[i], sigma[i], sigma[i]};
+	for (i = 0; i < 8; i++)
+		s[4 + i] = (cipherv4){key[i], key[i], key[i], key[i]};
+	s[12] = (cipherv4){counter, counter + 1, counter + 2, counter + 3};
+	for (i = 0; i < 3; i++)
+		s[13 + i] = (cipherv4){nonce[i], nonce[i], nonce[i], nonce[i]};
+
+	memcpy(x, s, sizeof(x));
+	for (i = 0; i < 10; i++) {
+		QUARTER(x[0], x[4], x[8], x[12]);
+		QUARTER(x[1], x[5], x[9], x[13]);
+		QUARTER(x[2], x[6], x[10], x[14]);
+		QUARTER(x[3], x[7], x[11], x[15]);
+		QUARTER(x[0], x[5], x[10], x[15]);
+		QUARTER(x[1], x[6], x[11], x[12]);
+		QUARTER(x[2], x[7], x[8], x[13]);
+		QUARTER(x[3], x[4], x[9], x[14]);
+	}
+	for (i = 0; i < 16; i++) {
+		x[i] += s[i];
+		for (j = 0; j < 4; j++)
+			out[j][i] = x[i][j];
+	}
+}
+
+static void cipherRun(const Uint32 key[8], const Uint32 nonce[3], Uint32 counter, Uint8 *data, Uint32 length)
+{
+	Uint32 stream[4][16];
+	Uint32 i, n, word;
+
+	while (length) {
+		cipherBlocks(key, nonce, counter, stream);
+		n = MIN(length, sizeof(stream));
+		// keystream words are serialised little endian
+		for (i = 0; i + 4 <= n; i += 4) {
+			memcpy(&word, data + i, 4);
+			word ^= sgeByteSwap32(stream[i / 64][i / 4 % 16]);
+			memcpy(data + i, &word, 4);
+		}
+		for (; i < n; i++)
+			data[i] ^= stream[i / 64][i / 4 % 16] >> (i % 4 * 8);
+		data += n;
+		length -= n;
+		counter += 4;
+	}
+}
+
+static int cipherWorker(void *data)
+{
+	struct cipherjob *job = data;
+
+	cipherRun(job->c->key, job->nonce, job->counter, job->data, job->length);
+	return 0;
+}
+
+void cipherInit(struct cipher *c, const char *password)
+{
+	char *first, *second, *salted;
+	char hex[3] = {0, 0, 0};
+	int i;
+
+	first = sgeSHA1((const unsigned char *)password, strlen(password));
+	sgeMallocNoInit(salted, char, strlen(first) + strlen(password) + 1);
+	sprintf(salted, "%s%s", first, password);
+	second = sgeSHA1((const unsigned char *)salted, strlen(salted));
+	for (i = 0; i < 32; i++) {
+		memcpy(hex, i < 20 ? first + i * 2 : second + (i - 20) * 2, 2);
+		((Uint8 *)c->key)[i] = strtoul(hex, NULL, 16);
+	}
+	for (i = 0; i < 8; i++)
+		c->key[i] = sgeByteSwap32(c->key[i]);
+	sgeFree(first);
+	sgeFree(second);
+	free(salted);
+}
+
+void cipherApply(struct cipher *c, const Uint32 nonce[3], Uint8 *data, Uint32 length)
+{
+	struct cipherjob jobs[CIPHER_THREADS];
+	SDL_Thread *threads[CIPHER_THREADS];
+	Uint32 piece, offset = 0;
+	int i;
+
+	if (length < CIPHER_PARALLEL) {
+		cipherRun(c->key, nonce, 0, data, length);
+		return;
+	}
+	// pieces start on block boundaries so each can compute its own counter
+	piece = (length / CIPHER_THREADS + 255) & ~255u;
+	for (i = 0; i < CIPHER_THREADS; i++) {
+		jobs[i].c = c;
+		jobs[i].nonce = nonce;
+		jobs[i].counter = offset / 64;
+		jobs[i].data = data + offset;
+		jobs[i].length = MIN(piece, length - offset);
+		offset += jobs[i].length;
+	}
+	for (i = 1; i < CIPHER_THREADS; i++)
+		threads[i] = SDL_CreateThread(cipherWorker, &jobs[i]);
+	cipherWorker(&jobs[0]);
+	for (i = 1; i < CIPHER_THREADS; i++) {
+		if (threads[i])
+			SDL_WaitThread(threads[i], NULL);
+		else
+			cipherWorker(&jobs[i]);
+	}
+}
@@ -0,0 +1,28 @@
+#ifndef _CIPHER_H
+#define _CIPHER_H
+
+#include <sge.h>
+
+// entries at least this long are split over CIPHER_THREADS threads
+#define CIPHER_PARALLEL (1 << 20)
+#define CIPHER_THREADS 4
+
+/*
+ * ChaCha20 (RFC 7539) for archive entries. The keystream is computed four
+ * 64 byte blocks at a time, one block per vector lane, and xored over the
+ * data in place. Block n of a stream only depends on the key, the nonce
+ * and n, so large buffers are cut into pieces that are processed in
+ * parallel.
+ *
+ * The key is derived from the archive password with SHA1, every entry
+ * must use a nonce of its own.
+ */
+struct cipher {
+	Uint32 key[8];
+};
+
+void cipherInit(struct cipher *c, const char *password);
+// encrypts and decrypts alike
+void cipherApply(struct cipher *c, const Uint32 nonce[3], Uint8 *data, Uint32 length);
+
+#endif
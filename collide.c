@@ -0,0 +1,51 @@
+#include "collide.h"
+#include "floordiv.h"
+
+static int collideSpan(struct collider *c, int along, int line, int from, int to)
+{
+	int i;
+
+	for (i = floorDiv(from, c->unit); i <= floorDiv(to - 1, c->unit); i++) {
+		if (along ? c->solid(line, i, c->data) : c->solid(i, line, c->data))
+			return 1;
+	}
+	return 0;
+}
+
+/*
+ * Move the interval [p, p + extent) by d along one axis, the box covers
+ * [from, to) on the other one. along is 1 when moving along x. Returns
+ * the distance that can be moved before touching a solid block.
+ */
+static int collideAxis(struct collider *c, int along, int p, int extent, int d, int from, int to, int *hit)
+{
+	int line, last;
+
+	*hit = 0;
+	if (d > 0) {
+		last = floorDiv(p + extent + d - 1, c->unit);
+		for (line = floorDiv(p + extent - 1, c->unit) + 1; line <= last; line++) {
+			if (collideSpan(c, along, line, from, to)) {
+				*hit = 1;
+				return line * c->unit - extent - p;
+			}
+		}
+	} else if (d < 0) {
+		last = floorDiv(p + d, c->unit);
+		for (line = floorDiv(p, c->unit) - 1; line >= last; line--) {
+			if (collideSpan(c, along, line, from, to)) {
+				*hit = -1;
+				return (line + 1) * c->unit - p;
+			}
+		}
+	}
+	return d;
+}
+
+void collideSweep(struct collider *c, int x, int y, int w, int h, int dx, int dy, struct sweep *out)
+{
+	out->dx = collideAxis(c, 1, x, w, dx, y, y + h, &out->hitX);
+	out->x = x + out->dx;
+	out->dy = collideAxis(c, 0, y, h, dy, out->x, out->x + w, &out->hitY);
+	out->y = y + out->dy;
+}
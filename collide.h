@@ -0,0 +1,27 @@
+#ifndef _COLLIDE_H
+#define _COLLIDE_H
+
+/*
+ * Swept box collision against a grid of blocks. Positions and sizes are
+ * in sub-block units, unit of them per block. The box is swept along x
+ * first and then along y, visiting only the columns and rows its leading
+ * edge crosses. A blocked axis stops at the contact and the other axis
+ * keeps its motion, so movement slides along walls.
+ */
+struct collider {
+	int unit;
+	int (*solid)(int blockX, int blockY, void *data);
+	void *data;
+};
+
+struct sweep {
+	// the box position after the move and the distance actually moved
+	int x, y;
+	int dx, dy;
+	// -1 or 1 if the move was stopped by a wall on that side, 0 otherwise
+	int hitX, hitY;
+};
+
+void collideSweep(struct collider *c, int x, int y, int w, int h, int dx, int dy, struct sweep *out);
+
+#endif
@@ -0,0 +1,14 @@
+#ifndef _FLOORDIV_H
+#define _FLOORDIV_H
+
+/*
+ * Division rounding towards negative infinity, for mapping block, chunk
+ * and pixel coordinates that may be negative onto the grid cell that
+ * contains them. n must be positive.
+ */
+static inline int floorDiv(int v, int n)
+{
+	return v >= 0 ? v / n : (v - n + 1) / n;
+}
+
+#endif
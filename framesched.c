@@ -0,0 +1,88 @@
+#include <time.h>
+#include <errno.h>
+#include "framesched.h"
+
+// defined in libsge, sgeGetFPS() returns it
+extern Uint32 sgeGlobalFPS;
+
+Uint64 frameSchedNow(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (Uint64)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void frameSchedSleepUntil(Uint64 deadline)
+{
+	struct timespec ts;
+
+	ts.tv_sec = deadline / 1000000000ull;
+	ts.tv_nsec = deadline % 1000000000ull;
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+		;
+}
+
+void frameSchedInit(struct framesched *s, int fps)
+{
+	memset(s, 0, sizeof(struct framesched));
+	s->period = fps > 0 ? 1000000000ull / fps : 0;
+	s->last = frameSchedNow();
+	s->next = s->last + s->period;
+}
+
+void frameSchedWait(struct framesched *s)
+{
+	Uint64 now = frameSchedNow();
+	double total = 0;
+	int i;
+
+	if (s->period) {
+		if (now + FRAMESCHED_SPIN < s->next)
+			frameSchedSleepUntil(s->next - FRAMESCHED_SPIN);
+		while ((now = frameSchedNow()) < s->next)
+			;
+		if (now - s->next > s->period) {
+			s->missed++;
+			s->next = now + s->period;
+		} else {
+			s->next += s->period;
+		}
+	}
+
+	s->times[s->pos] = (now - s->last) / 1000000.0f;
+	s->pos = (s->pos + 1) % FRAMESCHED_WINDOW;
+	if (s->count < FRAMESCHED_WINDOW)
+		s->count++;
+	s->last = now;
+	s->frames++;
+
+	if (s->pos == 0) {
+		for (i = 0; i < s->count; i++)
+			total += s->times[i];
+		sgeGlobalFPS = total > 0 ? sgeRound(1000.0 * s->count / total) : 0;
+	}
+}
+
+void frameSchedGetStats(struct framesched *s, struct framestats *stats)
+{
+	double sum = 0, squares = 0;
+	int i;
+
+	memset(stats, 0, sizeof(struct framestats));
+	stats->frames = s->frames;
+	stats->missed = s->missed;
+	if (!s->count)
+		return;
+
+	stats->min = stats->max = s->times[0];
+	for (i = 0; i < s->count; i++) {
+		sum += s->times[i];
+		squares += (double)s->times[i] * s->times[i];
+		stats->min = MIN(stats->min, s->times[i]);
+		stats->max = MAX(stats->max, s->times[i]);
+	}
+	stats->average = sum / s->count;
+	stats->jitter = sqrt(MAX(0, squares / s->count - stats->average * stats->average));
+	stats->fps = sum > 0 ? sgeRound(1000.0 * s->count / sum) : 0;
+}
@@ -0,0 +1,49 @@
+#ifndef _FRAMESCHED_H
+#define _FRAMESCHED_H
+
+#include <sge.h>
+
+#define FRAMESCHED_WINDOW 128
+// the last part of each wait is spent spinning, sleeps overshoot by about this much
+#define FRAMESCHED_SPIN 1000000
+
+/*
+ * Frame pacing on the monotonic clock. Waits sleep with clock_nanosleep
+ * until shortly before the deadline and spin for the rest, so frames
+ * start within microseconds of their slot instead of the ~10ms of the
+ * SDL timer. Deadlines advance by exactly one period, a frame that is
+ * late by more than a whole period is counted as missed and the
+ * schedule restarts from now.
+ *
+ * Frame times of the last FRAMESCHED_WINDOW frames are kept for
+ * statistics, the measured rate is also published to sgeGetFPS().
+ */
+struct framestats {
+	Uint32 fps;
+	// frame times in milliseconds over the window
+	double average, min, max;
+	double jitter;
+	Uint32 frames;
+	Uint32 missed;
+};
+
+struct framesched {
+	/** @privatesection */
+	Uint64 period;
+	Uint64 next;
+	Uint64 last;
+	float times[FRAMESCHED_WINDOW];
+	int count, pos;
+	Uint32 frames, missed;
+};
+
+// nanoseconds on the monotonic clock
+Uint64 frameSchedNow(void);
+
+// fps 0 does not pace, frames are only measured
+void frameSchedInit(struct framesched *s, int fps);
+// call once per frame, returns when the next frame is due
+void frameSchedWait(struct framesched *s);
+void frameSchedGetStats(struct framesched *s, struct framestats *stats);
+
+#endif
@@ -0,0 +1,138 @@
+#include "gameloop.h"
+#include "loader.h"
+#include "profile.h"
+
+static void gameLoopDispatch(SGEGAMESTATEMANAGER *manager, SGEEVENT *event)
+{
+	SGEGAMESTATE *state = manager->current;
+	int handled = EVENT_UNHANDLED;
+
+	switch (event->type) {
+	case SDL_QUIT:
+		sgeGameStateManagerQuit(manager);
+		return;
+	case SDL_KEYDOWN:
+		if (state->onKeyDown)
+			handled = state->onKeyDown(state, event);
+		break;
+	case SDL_KEYUP:
+		if (state->onKeyUp)
+			handled = state->onKeyUp(state, event);
+		break;
+	case SDL_JOYBUTTONDOWN:
+		if (state->onJoystickButtonDown)
+			handled = state->onJoystickButtonDown(state, event);
+		break;
+	case SDL_JOYBUTTONUP:
+		if (state->onJoystickButtonUp)
+			handled = state->onJoystickButtonUp(state, event);
+		break;
+	case SDL_JOYAXISMOTION:
+		if (state->onJoystickMove)
+			state->onJoystickMove(state, event);
+		break;
+	case SDL_MOUSEBUTTONDOWN:
+		if (state->onMouseDown)
+			state->onMouseDown(state, event);
+		return;
+	case SDL_MOUSEBUTTONUP:
+		if (state->onMouseUp)
+			state->onMouseUp(state, event);
+		return;
+	case SDL_MOUSEMOTION:
+		if (state->onMouseMove)
+			state->onMouseMove(state, event);
+		return;
+	default:
+		return;
+	}
+	if (handled == EVENT_UNHANDLED)
+		sgeEventApply(&manager->event_state, event);
+}
+
+void gameLoopInit(struct gameloop *loop, SGEGAMESTATEMANAGER *manager, int tickRate, int maxFps, void (*onUpdate)(SGEGAMESTATE *state, float dt))
+{
+	loop->manager = manager;
+	loop->tickRate = tickRate;
+	loop->maxFps = maxFps;
+	loop->onUpdate = onUpdate;
+	loop->alpha = 0;
+	loop->ticks = 0;
+	loop->replay = NULL;
+	loop->fixedStep = 0;
+}
+
+void gameLoopRun(struct gameloop *loop)
+{
+	SGEGAMESTATEMANAGER *manager = loop->manager;
+	struct replay *replay = loop->replay;
+	int playing = replay && replay->mode == REPLAY_PLAY;
+	SGEEVENT event;
+	Uint64 step = 1000000000ull / loop->tickRate;
+	Uint64 accumulator = 0;
+	Uint64 now, last;
+	int updates;
+
+	frameSchedInit(&loop->sched, loop->maxFps);
+	last = frameSchedNow();
+	while (!manager->quit) {
+		profileBegin(PROFILE_EVENTS);
+		while (SDL_PollEvent(&event)) {
+			if (playing && event.type != SDL_QUIT)
+				continue;
+			if (replay && replay->mode == REPLAY_RECORD)
+				replayWrite(replay, loop->ticks, &event);
+			gameLoopDispatch(manager, &event);
+		}
+		// finished assets are handed over before the update that may want them
+		loaderUpdate();
+		profileEnd(PROFILE_EVENTS);
+		if (manager->quit)
+			break;
+
+		now = frameSchedNow();
+		if (loop->fixedStep)
+			accumulator += step;
+		else
+			accumulator += MIN(now - last, GAMELOOP_MAXFRAME * 1000000ull);
+		last = now;
+
+		profileBegin(PROFILE_UPDATE);
+		for (updates = 0; accumulator >= step && updates < GAMELOOP_MAXTICKS; updates++) {
+			while (playing && replayRead(replay, loop->ticks, &event))
+				gameLoopDispatch(manager, &event);
+			if (loop->onUpdate)
+				loop->onUpdate(manager->current, step / 1000000000.0f);
+			accumulator -= step;
+			loop->ticks++;
+		}
+		// still behind after catching up, drop the backlog
+		if (accumulator >= step)
+			accumulator = 0;
+		profileEnd(PROFILE_UPDATE);
+
+		loop->alpha = (float)accumulator / step;
+		profileBegin(PROFILE_REDRAW);
+		manager->current->onRedraw(manager->current);
+		profileEnd(PROFILE_REDRAW);
+		frameSchedWait(&loop->sched);
+		profileFrameEnd();
+		if (playing && replayFinished(replay, loop->ticks))
+			sgeGameStateManagerQuit(manager);
+	}
+}
+
+float gameLoopAlpha(struct gameloop *loop)
+{
+	return loop->alpha;
+}
+
+Uint32 gameLoopTicks(struct gameloop *loop)
+{
+	return loop->ticks;
+}
+
+void gameLoopStats(struct gameloop *loop, struct framestats *stats)
+{
+	frameSchedGetStats(&loop->sched, stats);
+}
@@ -0,0 +1,61 @@
+#ifndef _GAMELOOP_H
+#define _GAMELOOP_H
+
+#include <sge.h>
+#include "framesched.h"
+#include "replay.h"
+
+#define GAMELOOP_MAXFRAME 250
+#define GAMELOOP_MAXTICKS 8
+
+/*
+ * Fixed timestep replacement for sgeGameStateManagerRun(). Events are
+ * dispatched to the manager's current state like the sge loop does,
+ * onUpdate is called tickRate times per second of real time and the
+ * state's onRedraw once per loop iteration, with alpha telling how far
+ * the display is between the last two ticks. Time is taken from the
+ * monotonic clock and redraws are paced by a frame scheduler.
+ *
+ * A slow frame is caught up with at most GAMELOOP_MAXTICKS updates and
+ * frames longer than GAMELOOP_MAXFRAME ms are clamped, the simulation
+ * then runs slower than real time instead of spiralling.
+ *
+ * With fixedStep set every iteration runs exactly one update, whatever
+ * the clock says. Headless sessions use it so a fast and a slow build
+ * simulate, load and draw the same ticks for the same frame count.
+ *
+ * With a replay attached live input is recorded with the tick it
+ * precedes, or ignored in favour of the recorded input, which is then
+ * dispatched right before its tick. The loop ends with the recording.
+ *
+ * Assets decoded by the asynchronous loader (loader.h) are finished and
+ * their callbacks run after the events of every iteration.
+ */
+struct gameloop {
+	SGEGAMESTATEMANAGER *manager;
+	int tickRate;
+	// 0 redraws as often as possible
+	int maxFps;
+	void (*onUpdate)(SGEGAMESTATE *state, float dt);
+	// NULL, or a replay that is recording or playing
+	struct replay *replay;
+	// nonzero runs one update per redraw instead of following the clock
+	int fixedStep;
+
+	/** @privatesection */
+	float alpha;
+	Uint32 ticks;
+	struct framesched sched;
+};
+
+void gameLoopInit(struct gameloop *loop, SGEGAMESTATEMANAGER *manager, int tickRate, int maxFps, void (*onUpdate)(SGEGAMESTATE *state, float dt));
+void gameLoopRun(struct gameloop *loop);
+
+// interpolation factor in [0, 1) for the current redraw
+float gameLoopAlpha(struct gameloop *loop);
+// number of updates run so far
+Uint32 gameLoopTicks(struct gameloop *loop);
+// measured redraw timing
+void gameLoopStats(struct gameloop *loop, struct framestats *stats);
+
+#endif
@@ -0,0 +1,141 @@
+#include <sge.h>
+#include "gen.h"
+#include "zone.h"
+
+static SDL_mutex *lock;
+static SDL_cond *wake;
+static SDL_Thread *workers[GEN_MAXWORKERS];
+static int numWorkers = 0;
+static int quit = 0;
+static void (*fillChunk)(struct chunk *c);
+
+static struct chunk *required = NULL, *requiredTail = NULL;
+static struct chunk *prefetched = NULL, *prefetchedTail = NULL;
+static struct chunk *finished = NULL;
+
+static void genPush(struct chunk **head, struct chunk **tail, struct chunk *c)
+{
+	c->next = NULL;
+	if (*tail)
+		(*tail)->next = c;
+	else
+		*head = c;
+	*tail = c;
+}
+
+static struct chunk *genPop(struct chunk **head, struct chunk **tail)
+{
+	struct chunk *c = *head;
+
+	if (c) {
+		*head = c->next;
+		if (!*head)
+			*tail = NULL;
+	}
+	return c;
+}
+
+void genPublish(struct chunk *c)
+{
+	struct chunk *head;
+
+	do {
+		head = finished;
+		c->next = head;
+	} while (!__sync_bool_compare_and_swap(&finished, head, c));
+}
+
+static int genWorker(void *data)
+{
+	struct chunk *c;
+
+	for (;;) {
+		SDL_LockMutex(lock);
+		while (!quit && !required && !prefetched)
+			SDL_CondWait(wake, lock);
+		if (quit) {
+			SDL_UnlockMutex(lock);
+			return 0;
+		}
+		c = genPop(&required, &requiredTail);
+		if (!c)
+			c = genPop(&prefetched, &prefetchedTail);
+		SDL_UnlockMutex(lock);
+
+		ZONE_BEGIN("fillChunk");
+		fillChunk(c);
+		ZONE_END();
+		genPublish(c);
+	}
+}
+
+void genStart(int count, void (*fill)(struct chunk *c))
+{
+	fillChunk = fill;
+	quit = 0;
+	lock = SDL_CreateMutex();
+	wake = SDL_CreateCond();
+	count = MINMAX(count, 1, GEN_MAXWORKERS);
+	for (numWorkers = 0; numWorkers < count; numWorkers++) {
+		workers[numWorkers] = SDL_CreateThread(genWorker, NULL);
+		if (!workers[numWorkers])
+			sgeBailOut("could not start chunk generator: %s\n", SDL_GetError());
+	}
+}
+
+void genStop(void)
+{
+	int i;
+
+	SDL_LockMutex(lock);
+	quit = 1;
+	SDL_CondBroadcast(wake);
+	SDL_UnlockMutex(lock);
+	for (i = 0; i < numWorkers; i++)
+		SDL_WaitThread(workers[i], NULL);
+	numWorkers = 0;
+	SDL_DestroyCond(wake);
+	SDL_DestroyMutex(lock);
+}
+
+void genRequest(struct chunk *c, int prefetch)
+{
+	SDL_LockMutex(lock);
+	if (prefetch)
+		genPush(&prefetched, &prefetchedTail, c);
+	else
+		genPush(&required, &requiredTail, c);
+	SDL_CondSignal(wake);
+	SDL_UnlockMutex(lock);
+}
+
+void genPromote(struct chunk *c)
+{
+	struct chunk *prev = NULL, *runner;
+
+	SDL_LockMutex(lock);
+	for (runner = prefetched; runner; prev = runner, runner = runner->next) {
+		if (runner != c)
+			continue;
+		if (prev)
+			prev->next = c->next;
+		else
+			prefetched = c->next;
+		if (prefetchedTail == c)
+			prefetchedTail = prev;
+		genPush(&required, &requiredTail, c);
+		break;
+	}
+	SDL_UnlockMutex(lock);
+}
+
+struct chunk *genCollect(void)
+{
+	struct chunk *list;
+
+	if (!finished)
+		return NULL;
+	// acquire barrier, pairs with the full barrier of the workers' CAS
+	list = __sync_lock_test_and_set(&finished, NULL);
+	return list;
+}
@@ -0,0 +1,27 @@
+#ifndef _GEN_H
+#define _GEN_H
+
+#include "chunk.h"
+
+#define GEN_MAXWORKERS 8
+
+/*
+ * Chunk generation worker pool. Chunks are queued either as required
+ * (needed on screen now) or as prefetch (one ring ahead of the player),
+ * workers always drain required jobs first. Finished chunks are pushed
+ * onto a lock free list which the render thread takes over in one
+ * atomic exchange with genCollect().
+ */
+void genStart(int workers, void (*fill)(struct chunk *c));
+void genStop(void);
+
+void genRequest(struct chunk *c, int prefetch);
+// moves a still queued prefetch job to the required queue
+void genPromote(struct chunk *c);
+
+// hands a filled chunk to the render thread, safe from any thread
+void genPublish(struct chunk *c);
+// returns the chunks finished since the last call, linked through next
+struct chunk *genCollect(void);
+
+#endif
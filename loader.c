@@ -0,0 +1,400 @@
+#include <sge.h>
+#include "loader.h"
+#include "zone.h"
+
+#define LOADER_HEAPINITIAL 64
+
+static struct pack *pack;
+static SDL_mutex *lock;
+static SDL_cond *wake;
+static SDL_Thread *workers[LOADER_MAXWORKERS];
+static int numWorkers = 0;
+static int quit = 0;
+
+// binary heap, the request to decode next at the top
+static struct loadrequest **heap = NULL;
+static int heapSize = 0, heapCapacity = 0;
+static Uint32 sequence = 0;
+
+// decoded, waiting for loaderUpdate()
+static struct loadrequest *finished = NULL, *finishedTail = NULL;
+// only touched by the main thread
+static int pending = 0;
+
+static int loaderBefore(struct loadrequest *a, struct loadrequest *b)
+{
+	if (a->priority != b->priority)
+		return a->priority > b->priority;
+	return (Sint32)(a->sequence - b->sequence) < 0;
+}
+
+static void loaderHeapSet(int i, struct loadrequest *r)
+{
+	heap[i] = r;
+	r->heapIndex = i;
+}
+
+static void loaderSiftUp(int i)
+{
+	struct loadrequest *r = heap[i];
+
+	while (i > 0 && loaderBefore(r, heap[(i - 1) / 2])) {
+		loaderHeapSet(i, heap[(i - 1) / 2]);
+		i = (i - 1) / 2;
+	}
+	loaderHeapSet(i, r);
+}
+
+static void loaderSiftDown(int i)
+{
+	struct loadrequest *r = heap[i];
+	int child;
+
+	while ((child = 2 * i + 1) < heapSize) {
+		if (child + 1 < heapSize && loaderBefore(heap[child + 1], heap[child]))
+			child++;
+		if (!loaderBefore(heap[child], r))
+			break;
+		loaderHeapSet(i, heap[child]);
+		i = child;
+	}
+	loaderHeapSet(i, r);
+}
+
+static void loaderHeapPush(struct loadrequest *r)
+{
+	if (heapSize == heapCapacity) {
+		heapCapacity = heapCapacity ? heapCapacity * 2 : LOADER_HEAPINITIAL;
+		heap = realloc(heap, heapCapacity * sizeof(struct loadrequest *));
+		if (!heap)
+			sgeBailOut("%s\n", "out of memory for load requests");
+	}
+	loaderHeapSet(heapSize++, r);
+	loaderSiftUp(r->heapIndex);
+}
+
+static void loaderHeapRemove(struct loadrequest *r)
+{
+	int i = r->heapIndex;
+	struct loadrequest *last = heap[--heapSize];
+
+	r->heapIndex = -1;
+	if (i == heapSize)
+		return;
+	loaderHeapSet(i, last);
+	loaderSiftUp(i);
+	loaderSiftDown(last->heapIndex);
+}
+
+static SDL_Surface *loaderDecodeImage(const char *name)
+{
+	SDL_Surface *image;
+	const void *data;
+	Uint32 size;
+
+	data = packRead(pack, name, &size);
+	if (!data)
+		return NULL;
+	image = IMG_Load_RW(SDL_RWFromConstMem(data, size), 1);
+	packRelease(pack, data);
+	return image;
+}
+
+// everything up to, but excluding, the display format
+static void loaderDecode(struct loadrequest *r)
+{
+	char name[MAXFILENAMELEN];
+	Uint32 i;
+
+	switch (r->type) {
+	case LOAD_DATA:
+		r->data = packRead(pack, r->name, &r->size);
+		break;
+	case LOAD_IMAGE:
+		r->image = loaderDecodeImage(r->name);
+		break;
+	case LOAD_SPRITE:
+		sgeMalloc(r->frames, SDL_Surface *, r->last - r->first + 1);
+		for (i = 0; i <= r->last - r->first; i++) {
+			if (!r->range)
+				snprintf(name, MAXFILENAMELEN, "%s", r->name);
+			else
+				snprintf(name, MAXFILENAMELEN, r->name, r->first + i);
+			r->frames[i] = loaderDecodeImage(name);
+		}
+		break;
+	case LOAD_SOUND:
+		r->sound = packReadSound(pack, r->name);
+		break;
+	}
+}
+
+static int loaderWorker(void *data)
+{
+	struct loadrequest *r;
+
+	for (;;) {
+		SDL_LockMutex(lock);
+		while (!quit && !heapSize)
+			SDL_CondWait(wake, lock);
+		if (quit) {
+			SDL_UnlockMutex(lock);
+			return 0;
+		}
+		r = heap[0];
+		loaderHeapRemove(r);
+		r->state = LOAD_DECODING;
+		SDL_UnlockMutex(lock);
+
+		ZONE_BEGIN("loaderDecode");
+		loaderDecode(r);
+		ZONE_END();
+
+		SDL_LockMutex(lock);
+		r->state = LOAD_DECODED;
+		r->next = NULL;
+		if (finishedTail)
+			finishedTail->next = r;
+		else
+			finished = r;
+		finishedTail = r;
+		SDL_UnlockMutex(lock);
+	}
+}
+
+static void loaderDropResults(struct loadrequest *r)
+{
+	Uint32 i;
+
+	if (r->image)
+		SDL_FreeSurface(r->image);
+	if (r->sound)
+		Mix_FreeChunk(r->sound);
+	if (r->data)
+		packRelease(pack, r->data);
+	if (r->frames) {
+		for (i = 0; i <= r->last - r->first; i++) {
+			if (r->frames[i])
+				SDL_FreeSurface(r->frames[i]);
+		}
+		free(r->frames);
+	}
+	r->image = NULL;
+	r->sound = NULL;
+	r->data = NULL;
+	r->frames = NULL;
+}
+
+static void loaderDestroy(struct loadrequest *r)
+{
+	free(r->name);
+	free(r);
+}
+
+static int loaderFinishSprite(struct loadrequest *r)
+{
+	SDL_Surface *converted;
+	Uint32 i;
+
+	for (i = 0; i <= r->last - r->first; i++) {
+		if (!r->frames[i])
+			return 0;
+	}
+	r->sprite = sgeSpriteNew();
+	for (i = 0; i <= r->last - r->first; i++) {
+		converted = SDL_DisplayFormatAlpha(r->frames[i]);
+		if (!converted) {
+			// the frames not yet converted are dropped with the request
+			sgeSpriteDestroy(r->sprite);
+			r->sprite = NULL;
+			return 0;
+		}
+		SDL_FreeSurface(r->frames[i]);
+		r->frames[i] = NULL;
+		sgeSpriteAddSDLSurface(r->sprite, converted);
+	}
+	return 1;
+}
+
+static void loaderFinish(struct loadrequest *r)
+{
+	SDL_Surface *converted;
+	int ok = 0;
+
+	if (r->cancelled) {
+		loaderDropResults(r);
+		loaderDestroy(r);
+		return;
+	}
+	switch (r->type) {
+	case LOAD_DATA:
+		ok = r->data != NULL;
+		break;
+	case LOAD_IMAGE:
+		if (r->image) {
+			converted = SDL_DisplayFormatAlpha(r->image);
+			SDL_FreeSurface(r->image);
+			r->image = converted;
+		}
+		ok = r->image != NULL;
+		break;
+	case LOAD_SPRITE:
+		ok = loaderFinishSprite(r);
+		break;
+	case LOAD_SOUND:
+		ok = r->sound != NULL;
+		break;
+	}
+	if (!ok)
+		loaderDropResults(r);
+	sgeFree(r->frames);
+	r->state = ok ? LOAD_DONE : LOAD_FAILED;
+	pending--;
+	// the callback may free the request
+	if (r->done)
+		r->done(r, r->userData);
+}
+
+void loaderStart(struct pack *p, int count)
+{
+	pack = p;
+	quit = 0;
+	lock = SDL_CreateMutex();
+	wake = SDL_CreateCond();
+	count = MINMAX(count, 1, LOADER_MAXWORKERS);
+	for (numWorkers = 0; numWorkers < count; numWorkers++) {
+		workers[numWorkers] = SDL_CreateThread(loaderWorker, NULL);
+		if (!workers[numWorkers])
+			sgeBailOut("could not start asset loader: %s\n", SDL_GetError());
+	}
+}
+
+// the caller's handles stay valid and report LOAD_FAILED
+static void loaderAbandon(struct loadrequest *r)
+{
+	loaderDropResults(r);
+	if (r->cancelled) {
+		loaderDestroy(r);
+		return;
+	}
+	r->state = LOAD_FAILED;
+	r->heapIndex = -1;
+}
+
+void loaderStop(void)
+{
+	struct loadrequest *r;
+	int i;
+
+	SDL_LockMutex(lock);
+	quit = 1;
+	SDL_CondBroadcast(wake);
+	SDL_UnlockMutex(lock);
+	for (i = 0; i < numWorkers; i++)
+		SDL_WaitThread(workers[i], NULL);
+	numWorkers = 0;
+
+	for (i = 0; i < heapSize; i++)
+		loaderAbandon(heap[i]);
+	while ((r = finished)) {
+		finished = r->next;
+		loaderAbandon(r);
+	}
+	finishedTail = NULL;
+	sgeFree(heap);
+	heapSize = heapCapacity = 0;
+	pending = 0;
+	SDL_DestroyCond(wake);
+	SDL_DestroyMutex(lock);
+}
+
+static struct loadrequest *loaderQueue(int type, const char *name, Uint32 first, Uint32 last, int range, int priority, void (*done)(struct loadrequest *r, void *userData), void *userData)
+{
+	struct loadrequest *r;
+
+	if (!numWorkers)
+		sgeBailOut("%s\n", "the asset loader is not running");
+	sgeNew(r, struct loadrequest);
+	r->type = type;
+	r->priority = priority;
+	r->state = LOAD_QUEUED;
+	r->done = done;
+	r->userData = userData;
+	r->name = strdup(name);
+	r->first = first;
+	r->last = last;
+	r->range = range;
+
+	SDL_LockMutex(lock);
+	r->sequence = sequence++;
+	loaderHeapPush(r);
+	SDL_CondSignal(wake);
+	SDL_UnlockMutex(lock);
+	pending++;
+	return r;
+}
+
+struct loadrequest *loaderRequest(int type, const char *name, int priority, void (*done)(struct loadrequest *r, void *userData), void *userData)
+{
+	// a single frame sprite is a range of one
+	return loaderQueue(type, name, 0, 0, 0, priority, done, userData);
+}
+
+struct loadrequest *loaderRequestRange(const char *templ, Uint32 first, Uint32 last, int priority, void (*done)(struct loadrequest *r, void *userData), void *userData)
+{
+	if (last < first)
+		sgeBailOut("empty sprite range %s\n", templ);
+	return loaderQueue(LOAD_SPRITE, templ, first, last, 1, priority, done, userData);
+}
+
+void loaderSetPriority(struct loadrequest *r, int priority)
+{
+	SDL_LockMutex(lock);
+	r->priority = priority;
+	if (r->state == LOAD_QUEUED && r->heapIndex >= 0) {
+		loaderSiftUp(r->heapIndex);
+		loaderSiftDown(r->heapIndex);
+	}
+	SDL_UnlockMutex(lock);
+}
+
+int loaderDone(struct loadrequest *r)
+{
+	return r->state >= LOAD_DONE;
+}
+
+void loaderFree(struct loadrequest *r)
+{
+	if (r->state >= LOAD_DONE) {
+		loaderDestroy(r);
+		return;
+	}
+	SDL_LockMutex(lock);
+	pending--;
+	if (r->state == LOAD_QUEUED) {
+		loaderHeapRemove(r);
+		SDL_UnlockMutex(lock);
+		loaderDestroy(r);
+		return;
+	}
+	// a worker has it, loaderUpdate() disposes of it
+	r->cancelled = 1;
+	SDL_UnlockMutex(lock);
+}
+
+int loaderUpdate(void)
+{
+	struct loadrequest *r, *next;
+
+	if (!numWorkers)
+		return 0;
+	SDL_LockMutex(lock);
+	r = finished;
+	finished = finishedTail = NULL;
+	SDL_UnlockMutex(lock);
+	for (; r; r = next) {
+		next = r->next;
+		loaderFinish(r);
+	}
+	return pending;
+}
@@ -0,0 +1,80 @@
+#ifndef _LOADER_H
+#define _LOADER_H
+
+#include <sge.h>
+#include "pack.h"
+
+#define LOADER_MAXWORKERS 4
+
+// request types
+#define LOAD_DATA 0
+#define LOAD_IMAGE 1
+#define LOAD_SPRITE 2
+#define LOAD_SOUND 3
+
+// request states
+#define LOAD_QUEUED 0
+#define LOAD_DECODING 1
+#define LOAD_DECODED 2
+#define LOAD_DONE 3
+#define LOAD_FAILED 4
+
+/*
+ * Asynchronous loading from a pack. Requests are queued with a priority,
+ * the highest is decoded next by a pool of worker threads, equal ones in
+ * the order they were made. Workers read, decrypt and decode the entry;
+ * what has to happen on the main thread, converting images to the
+ * display format and assembling sprites, is done by loaderUpdate(), which
+ * the game loop calls once per frame. That is also where the completion
+ * callbacks run, so they may touch game state freely.
+ *
+ * A request is finished once loaderDone() returns true, its result then
+ * belongs to the caller: surfaces go to SDL_FreeSurface(), sprites to
+ * sgeSpriteDestroy(), sounds to Mix_FreeChunk() and data to packRelease().
+ * Fonts and SGESOUNDs keep their internals private and are still loaded
+ * with the blocking sge functions.
+ */
+struct loadrequest {
+	int type;
+	int priority;
+	int state;
+	// the result, depending on type
+	SDL_Surface *image;
+	SGESPRITE *sprite;
+	Mix_Chunk *sound;
+	const void *data;
+	Uint32 size;
+	// called from loaderUpdate() when the request has finished, may be NULL
+	void (*done)(struct loadrequest *r, void *userData);
+	void *userData;
+
+	/** @privatesection */
+	char *name;
+	Uint32 first, last;
+	// name is a template for first to last
+	int range;
+	SDL_Surface **frames;
+	Uint32 sequence;
+	int heapIndex;
+	int cancelled;
+	struct loadrequest *next;
+};
+
+void loaderStart(struct pack *p, int workers);
+// requests not finished yet are dropped along with their results
+void loaderStop(void);
+
+struct loadrequest *loaderRequest(int type, const char *name, int priority, void (*done)(struct loadrequest *r, void *userData), void *userData);
+// an animated sprite from templ formatted with first to last, like sgeSpriteNewFileRange()
+struct loadrequest *loaderRequestRange(const char *templ, Uint32 first, Uint32 last, int priority, void (*done)(struct loadrequest *r, void *userData), void *userData);
+// takes effect if the request is still queued
+void loaderSetPriority(struct loadrequest *r, int priority);
+
+int loaderDone(struct loadrequest *r);
+// releases the handle, a request still in progress is cancelled
+void loaderFree(struct loadrequest *r);
+
+// main thread only, finishes decoded requests, returns the number still pending
+int loaderUpdate(void);
+
+#endif
@@ -0,0 +1,135 @@
+#include "lz.h"
+
+static inline Uint32 lzRead32(const Uint8 *p)
+{
+	Uint32 v;
+
+	memcpy(&v, p, 4);
+	return v;
+}
+
+static inline Uint32 lzHash(Uint32 v)
+{
+	return (v * 2654435761u) >> (32 - LZ_HASHBITS);
+}
+
+// writes the length bytes beyond the 15 stored in a token nibble
+static Uint8 *lzPutLength(Uint8 *out, Uint8 *end, Uint32 length)
+{
+	for (length -= 15; length >= 255; length -= 255) {
+		if (out == end)
+			return NULL;
+		*out++ = 255;
+	}
+	if (out == end)
+		return NULL;
+	*out++ = length;
+	return out;
+}
+
+static Uint8 *lzSequence(Uint8 *out, Uint8 *end, const Uint8 *literals, Uint32 numLiterals, Uint32 offset, Uint32 matchLength)
+{
+	Uint8 *token = out++;
+	Uint32 match = matchLength ? matchLength - LZ_MINMATCH : 0;
+
+	if (token >= end)
+		return NULL;
+	*token = MIN(numLiterals, 15) << 4 | MIN(match, 15);
+	if (numLiterals >= 15 && !(out = lzPutLength(out, end, numLiterals)))
+		return NULL;
+	if ((Uint32)(end - out) < numLiterals)
+		return NULL;
+	memcpy(out, literals, numLiterals);
+	out += numLiterals;
+	if (!matchLength)
+		return out;
+	if (end - out < 2)
+		return NULL;
+	*out++ = offset & 0xFF;
+	*out++ = offset >> 8;
+	if (match >= 15)
+		out = lzPutLength(out, end, match);
+	return out;
+}
+
+Uint32 lzCompress(const Uint8 *src, Uint32 length, Uint8 *dst, Uint32 capacity)
+{
+	// positions plus one, 0 is an empty slot; one candidate per hash and
+	// no chains, a colliding position simply replaces the older one
+	Uint32 table[1 << LZ_HASHBITS];
+	Uint8 *out = dst, *end = dst + capacity;
+	Uint32 ip = 0, anchor = 0, ref, h, match;
+
+	memset(table, 0, sizeof(table));
+	while (length >= LZ_MINMATCH && ip <= length - LZ_MINMATCH) {
+		h = lzHash(lzRead32(src + ip));
+		ref = table[h];
+		table[h] = ip + 1;
+		if (!ref-- || ip - ref > 0xFFFF || lzRead32(src + ref) != lzRead32(src + ip)) {
+			ip++;
+			continue;
+		}
+		for (match = LZ_MINMATCH; ip + match < length && src[ref + match] == src[ip + match]; match++)
+			;
+		out = lzSequence(out, end, src + anchor, ip - anchor, ip - ref, match);
+		if (!out)
+			return 0;
+		ip += match;
+		anchor = ip;
+	}
+	out = lzSequence(out, end, src + anchor, length - anchor, 0, 0);
+	return out ? out - dst : 0;
+}
+
+static int lzGetLength(const Uint8 **in, const Uint8 *end, Uint32 *length)
+{
+	Uint8 b;
+
+	if (*length != 15)
+		return 1;
+	do {
+		if (*in == end)
+			return 0;
+		b = *(*in)++;
+		*length += b;
+	} while (b == 255);
+	return 1;
+}
+
+int lzDecompress(const Uint8 *src, Uint32 srcLength, Uint8 *dst, Uint32 length)
+{
+	const Uint8 *in = src, *inEnd = src + srcLength;
+	Uint8 *out = dst, *outEnd = dst + length;
+	Uint32 numLiterals, match, offset;
+	Uint8 token;
+
+	while (in < inEnd) {
+		token = *in++;
+		numLiterals = token >> 4;
+		if (!lzGetLength(&in, inEnd, &numLiterals) ||
+		    (Uint32)(inEnd - in) < numLiterals || (Uint32)(outEnd - out) < numLiterals)
+			return 0;
+		memcpy(out, in, numLiterals);
+		in += numLiterals;
+		out += numLiterals;
+		if (in == inEnd)
+			break;
+
+		if (inEnd - in < 2)
+			return 0;
+		offset = in[0] | in[1] << 8;
+		in += 2;
+		match = token & 15;
+		if (!lzGetLength(&in, inEnd, &match))
+			return 0;
+		match += LZ_MINMATCH;
+		if (!offset || offset > (Uint32)(out - dst) || (Uint32)(outEnd - out) < match)
+			return 0;
+		// overlapping copies repeat the last offset bytes, byte by byte on purpose
+		while (match--) {
+			*out = *(out - offset);
+			out++;
+		}
+	}
+	return out == outEnd;
+}
@@ -0,0 +1,23 @@
+#ifndef _LZ_H
+#define _LZ_H
+
+#include <sge.h>
+
+/*
+ * Byte oriented LZ77 in the style of LZ4 blocks: each sequence is a token
+ * holding a literal count and a match length in its two nibbles (15 means
+ * more length bytes follow, each adding up to 255), the literals, then a
+ * 2 byte little endian offset back into the output. The last sequence is
+ * literals only. Matches are at least LZ_MINMATCH bytes and found
+ * greedily through a hash of the next 4 bytes that remembers only the
+ * last position per slot, decoding is a plain copy loop.
+ */
+#define LZ_MINMATCH 4
+#define LZ_HASHBITS 12
+
+// compressed size, 0 if the result would not fit into capacity
+Uint32 lzCompress(const Uint8 *src, Uint32 length, Uint8 *dst, Uint32 capacity);
+// returns 1 if src decoded to exactly length bytes
+int lzDecompress(const Uint8 *src, Uint32 srcLength, Uint8 *dst, Uint32 length);
+
+#endif
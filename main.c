@@ -1,19 +1,65 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <time.h>
+#include <unistd.h>
+#include <dirent.h>
 #include <sge.h>
+#include "chunk.h"
+#include "floordiv.h"
+#include "residency.h"
+#include "gen.h"
+#include "region.h"
+#include "worldgen.h"
+#include "collide.h"
+#include "gameloop.h"
+#include "profile.h"
+#include "zone.h"
+#include "replay.h"
 
-#define CHUNKSIZE 10
 #define BLOCKSIZE 5
 #define PRECISION 32
+// defaults, --radius raises the others with it
+#define LOADRADIUS 1
+#define GENWORKERS 2
+#define KEEPRADIUS 3
+#define MAXCHUNKS 128
+#define WORLDDIR "world"
+// played back sessions start from an empty world that is removed on exit,
+// so every playback sees the same chunks the recording did
+#define REPLAYDIR "replay-XXXXXX"
+#define PLAYERSIZE (PRECISION * 3 / 5)
+#define TICKRATE 60
+#define MAXFPS 120
+#define PROFILECSV "profile.csv"
+#define ZONETRACE "trace.json"
+// headless frame dumps, numbered by frame
+#define DUMPFILE "frame%06u.bmp"
+// the overlay font comes from the data file if there is one, the
+// profiler's built-in font is used otherwise
+#define DATAFILE "data.d"
+#define DATAKEY "spaaaace"
+#define OVERLAYFONT "font.png"
+// sub-block units per tick, eight blocks per second
+#define SPEED (PRECISION * 8 / TICKRATE)
 
-struct chunk {
-	int myX, myY;
-	int types[CHUNKSIZE][CHUNKSIZE];
-	struct chunk *next;
-};
+#define HELD_LEFT 1
+#define HELD_RIGHT 2
+#define HELD_UP 4
+#define HELD_DOWN 8
+// the autopilot changes direction this often, drifting right into new chunks
+#define AUTOPILOT_TICKS (TICKRATE * 2)
+
+#define USAGE "usage: %s [--headless] [--frames n] [--dump every] [--autopilot] [--world dir] [--seed n] [--radius n] [--record file | --play file]\n"
 
-struct chunk *firstChunk = NULL;
+char worldDir[MAXFILENAMELEN] = WORLDDIR;
+struct chunkstore chunks;
+struct residency resident;
+unsigned int worldSeed;
+
+const uint32_t blockColors[BLOCK_TYPES] = {
+	0xFF000000, 0xFF808080, 0xFFA0E0FF, 0xFFE0C070,
+	0xFF806040, 0xFF40C040, 0xFFF0F0F0, 0xFFC040FF
+};
 
 struct position {
 	int chunkX, chunkY;
@@ -21,168 +67,492 @@ struct position {
 };
 
 struct position myPos;
+// position at the previous tick and the one interpolated for drawing
+struct position prevPos, viewPos;
+int held = 0;
+struct gameloop loop;
+SGEFILE *data = NULL;
+SGEFONT *overlayFont = NULL;
+int showOverlay = 0;
+// --headless renders offscreen, unpaced, for benchmarks and unattended runs
+int headless = 0;
+Uint32 maxFrames = 0;
+Uint32 dumpEvery = 0;
+Uint32 frame = 0;
+// --autopilot replaces the keyboard with a fixed route, for training runs,
+// recordings remember it
+int autopilot = 0;
+const int autopilotKeys[4] = {
+	HELD_RIGHT, HELD_RIGHT | HELD_DOWN, HELD_DOWN, HELD_RIGHT | HELD_UP
+};
+// --record and --play
+struct replay replay;
+const char *recordFile = NULL;
+const char *playFile = NULL;
+// --seed for a new world instead of the clock, so scripted sessions are repeatable
+int fixedSeed = 0;
+unsigned int newSeed;
+// --radius chunks around the player are required, a margin past the
+// prefetch ring stays in memory
+int loadRadius = LOADRADIUS;
+int keepRadius = KEEPRADIUS;
+int maxChunks = MAXCHUNKS;
 
-char isInsideAnything(struct position where)
+void normalizePosition(struct position *p)
 {
-	struct chunk *runner = firstChunk;
-	while (runner) {
-		if (runner->myX == where.chunkX && runner->myY == where.chunkY) {
-			return (0 != runner->types[where.y/PRECISION][where.x/PRECISION]);
-		}
-		runner = runner->next;
+	while (p->x < 0) {
+		p->x += PRECISION * CHUNKSIZE;
+		p->chunkX--;
+	}
+	while (p->x >= PRECISION * CHUNKSIZE) {
+		p->x -= PRECISION * CHUNKSIZE;
+		p->chunkX++;
+	}
+	while (p->y < 0) {
+		p->y += PRECISION * CHUNKSIZE;
+		p->chunkY--;
+	}
+	while (p->y >= PRECISION * CHUNKSIZE) {
+		p->y -= PRECISION * CHUNKSIZE;
+		p->chunkY++;
 	}
-	return 0;
 }
 
-void move(int dx, int dy)
+// block coordinates relative to a chunk, remembering the last chunk looked up
+struct solidQuery {
+	int chunkX, chunkY;
+	struct chunk *last;
+};
+
+int isSolid(int blockX, int blockY, void *data)
 {
-	struct position oldPos = myPos;
+	struct solidQuery *q = data;
+	int offsetX = floorDiv(blockX, CHUNKSIZE);
+	int offsetY = floorDiv(blockY, CHUNKSIZE);
+	struct chunk *c = q->last;
 
-	myPos.x += dx;
-	while (myPos.x < 0) {
-		myPos.x += PRECISION * CHUNKSIZE;
-		myPos.chunkX--;
-	}
-	while (myPos.x >= PRECISION * CHUNKSIZE) {
-		myPos.x -= PRECISION * CHUNKSIZE;
-		myPos.chunkX++;
-	}
-	myPos.y += dy;
-	while (myPos.y < 0) {
-		myPos.y += PRECISION * CHUNKSIZE;
-		myPos.chunkY--;
-	}
-	while (myPos.y >= PRECISION * CHUNKSIZE) {
-		myPos.y -= PRECISION * CHUNKSIZE;
-		myPos.chunkY++;
-	}
+	if (!c || c->myX != q->chunkX + offsetX || c->myY != q->chunkY + offsetY)
+		c = q->last = chunkStoreGet(&chunks, q->chunkX + offsetX, q->chunkY + offsetY);
+	// don't walk into terrain that has not been loaded or generated yet
+	if (!c || c->state != CHUNK_READY)
+		return 1;
+	return (0 != chunkGetBlock(c, blockX - offsetX * CHUNKSIZE, blockY - offsetY * CHUNKSIZE));
+}
+
+void move(int dx, int dy)
+{
+	struct solidQuery query = {.chunkX = myPos.chunkX, .chunkY = myPos.chunkY, .last = NULL};
+	struct collider collider = {.unit = PRECISION, .solid = isSolid, .data = &query};
+	struct sweep sweep;
 
-	if (isInsideAnything(myPos))
-		myPos = oldPos;
+	collideSweep(&collider, myPos.x - PLAYERSIZE / 2, myPos.y - PLAYERSIZE / 2, PLAYERSIZE, PLAYERSIZE, dx, dy, &sweep);
+	myPos.x += sweep.dx;
+	myPos.y += sweep.dy;
+	normalizePosition(&myPos);
 }
 
-int keyFunc(SGEGAMESTATE *state, SGEEVENT *event)
+int heldKey(SGEEVENT *event)
 {
 	switch (event->key.keysym.sym) {
 	case SDLK_LEFT:
-		move(-PRECISION, 0);
-		break;
+		return HELD_LEFT;
 	case SDLK_RIGHT:
-		move(PRECISION, 0);
-		break;
+		return HELD_RIGHT;
 	case SDLK_UP:
-		move(0, -PRECISION);
-		break;
+		return HELD_UP;
 	case SDLK_DOWN:
-		move(0, PRECISION);
-		break;
-	case SDLK_ESCAPE:
-		sgeGameStateManagerQuit(state->manager);
-		break;
+		return HELD_DOWN;
 	default:
-		return EVENT_UNHANDLED;
+		return 0;
 	}
-	
-	return EVENT_HANDLED;
 }
 
-void generateChunk(int x, int y)
+int keyFunc(SGEGAMESTATE *state, SGEEVENT *event)
+{
+	int key = heldKey(event);
+
+	if (key) {
+		held |= key;
+		return EVENT_HANDLED;
+	}
+	if (event->key.keysym.sym == SDLK_ESCAPE) {
+		sgeGameStateManagerQuit(state->manager);
+		return EVENT_HANDLED;
+	}
+	if (event->key.keysym.sym == SDLK_F3) {
+		showOverlay = !showOverlay;
+		return EVENT_HANDLED;
+	}
+	return EVENT_UNHANDLED;
+}
+
+int keyUpFunc(SGEGAMESTATE *state, SGEEVENT *event)
+{
+	int key = heldKey(event);
+
+	if (key) {
+		held &= ~key;
+		return EVENT_HANDLED;
+	}
+	return EVENT_UNHANDLED;
+}
+
+// runs on the generator worker threads
+void fillChunk(struct chunk *c)
+{
+	unsigned char types[CHUNKSIZE][CHUNKSIZE];
+	worldGenChunk(c->myX, c->myY, &types[0][0]);
+	chunkSetBlocks(c, &types[0][0]);
+}
+
+// the seed is kept with the world so evicted chunks regenerate identically
+unsigned int readWorldSeed(void)
+{
+	char filename[MAXFILENAMELEN + sizeof("/seed")];
+	unsigned int seed;
+	FILE *f;
+
+	snprintf(filename, sizeof(filename), "%s/seed", worldDir);
+	f = fopen(filename, "r");
+	if (f) {
+		if (fscanf(f, "%u", &seed) == 1) {
+			fclose(f);
+			return seed;
+		}
+		fclose(f);
+	}
+	seed = fixedSeed ? newSeed : time(NULL);
+	f = fopen(filename, "w");
+	if (f) {
+		fprintf(f, "%u\n", seed);
+		fclose(f);
+	}
+	return seed;
+}
+
+// a playback world only ever holds the region files, so a flat sweep will do
+void removeWorld(const char *dir)
+{
+	char filename[MAXFILENAMELEN * 2];
+	struct dirent *entry;
+	DIR *d;
+
+	d = opendir(dir);
+	if (d) {
+		while ((entry = readdir(d))) {
+			if (entry->d_name[0] == '.')
+				continue;
+			snprintf(filename, sizeof(filename), "%s/%s", dir, entry->d_name);
+			unlink(filename);
+		}
+		closedir(d);
+	}
+	if (rmdir(dir))
+		fprintf(stderr, "could not remove %s\n", dir);
+}
+
+void loadChunk(int x, int y, int prefetch)
 {
 	struct chunk *newChunk = malloc(sizeof(struct chunk));
 	newChunk->myX = x;
 	newChunk->myY = y;
-	newChunk->next = firstChunk;
-	firstChunk = newChunk;
-	for (x = 0; x < CHUNKSIZE; x++) {
-		for (y = 0; y < CHUNKSIZE; y++) {
-			newChunk->types[y][x] = random() % 4 == 0;
-		}
+	newChunk->state = CHUNK_QUEUED;
+	newChunk->surface = NULL;
+	newChunk->dirty = 0;
+	chunkInitBlocks(newChunk, 0);
+	chunkStoreInsert(&chunks, newChunk);
+	regionLoad(newChunk, prefetch);
+}
+
+void requireChunk(int x, int y, void *data)
+{
+	struct chunk *c = chunkStoreGet(&chunks, x, y);
+	if (!c)
+		loadChunk(x, y, 0);
+	else if (c->state == CHUNK_QUEUED)
+		regionPromote(c);
+}
+
+void prefetchChunk(int x, int y, void *data)
+{
+	if (!chunkStoreGet(&chunks, x, y))
+		loadChunk(x, y, 1);
+}
+
+void countReady(struct chunk *c, void *data)
+{
+	if (c->state == CHUNK_READY)
+		(*(int *)data)++;
+}
+
+/*
+ * isSolid() can only guess at chunks that are still loading, so replays
+ * and headless runs block until every chunk the player can touch this
+ * tick is ready. The result then doesn't depend on the loader threads.
+ */
+void awaitChunks(void)
+{
+	int reach = PLAYERSIZE / 2 + SPEED + PRECISION;
+	int x0 = myPos.chunkX + floorDiv(floorDiv(myPos.x - reach, PRECISION), CHUNKSIZE);
+	int y0 = myPos.chunkY + floorDiv(floorDiv(myPos.y - reach, PRECISION), CHUNKSIZE);
+	int x1 = myPos.chunkX + floorDiv(floorDiv(myPos.x + reach, PRECISION), CHUNKSIZE);
+	int y1 = myPos.chunkY + floorDiv(floorDiv(myPos.y + reach, PRECISION), CHUNKSIZE);
+	struct chunk *c;
+	int x, y, ready = 0;
+
+	chunkStoreForEachIn(&chunks, x0, y0, x1, y1, countReady, &ready);
+	if (ready == (x1 - x0 + 1) * (y1 - y0 + 1))
+		return;
+	ZONE_BEGIN("awaitChunks");
+	for (y = y0; y <= y1; y++) {
+		for (x = x0; x <= x1; x++)
+			requireChunk(x, y, NULL);
+	}
+	while (ready < (x1 - x0 + 1) * (y1 - y0 + 1)) {
+		SDL_Delay(1);
+		for (c = genCollect(); c; c = c->next)
+			c->state = CHUNK_READY;
+		ready = 0;
+		chunkStoreForEachIn(&chunks, x0, y0, x1, y1, countReady, &ready);
 	}
+	ZONE_END();
 }
 
-void onRedraw(SGEGAMESTATE *state)
+void onUpdate(SGEGAMESTATE *state, float dt)
+{
+	int dx = 0, dy = 0;
+
+	prevPos = myPos;
+	if (loop.fixedStep || loop.replay)
+		awaitChunks();
+	if (autopilot)
+		held = autopilotKeys[gameLoopTicks(&loop) / AUTOPILOT_TICKS % 4];
+	if (held & HELD_LEFT)
+		dx -= SPEED;
+	if (held & HELD_RIGHT)
+		dx += SPEED;
+	if (held & HELD_UP)
+		dy -= SPEED;
+	if (held & HELD_DOWN)
+		dy += SPEED;
+	if (dx || dy)
+		move(dx, dy);
+}
+
+void touchChunk(struct chunk *c, void *data)
+{
+	chunkStoreTouch(&chunks, c);
+}
+
+void saveChunk(struct chunk *c, void *data)
 {
-	//This is inefficient - we should only have to check for chunks whenever I cross a chunk border.
-	int requiredChunks[9][2];
-	int numRequired = 0;
+	if (c->state == CHUNK_READY && c->dirty)
+		regionSave(c);
+}
+
+// write out and free the least recently used chunks outside keepRadius
+void evictChunks(void)
+{
+	struct chunk *c, *newer;
+
+	chunkStoreForEachIn(&chunks, myPos.chunkX - keepRadius, myPos.chunkY - keepRadius,
+		myPos.chunkX + keepRadius, myPos.chunkY + keepRadius, touchChunk, NULL);
+
+	for (c = chunkStoreOldest(&chunks); c && chunks.count > maxChunks; c = newer) {
+		newer = c->newer;
+		if (abs(c->myX - myPos.chunkX) <= keepRadius && abs(c->myY - myPos.chunkY) <= keepRadius)
+			break;
+		// queued chunks still belong to the loader or the generator
+		if (c->state != CHUNK_READY)
+			continue;
+		saveChunk(c, NULL);
+		chunkStoreRemove(&chunks, c->myX, c->myY);
+		if (c->surface)
+			SDL_FreeSurface(c->surface);
+		chunkFreeBlocks(c);
+		free(c);
+	}
+}
+
+// bring the chunk's cached surface up to date with its blocks
+void renderChunk(struct chunk *c)
+{
+	SDL_Rect r = {.w = BLOCKSIZE, .h = BLOCKSIZE};
+	unsigned char types[CHUNKSIZE][CHUNKSIZE];
 	int i, j;
-	int x, y;
-	for (i = -1; i <= 1; i++) {
-		for (j = -1; j <= 1; j++) {
-			requiredChunks[numRequired][0] = myPos.chunkX+i;
-			requiredChunks[numRequired][1] = myPos.chunkY+j;
-			numRequired++;
+
+	c->redraw = 0;
+	// all air chunks need no surface at all
+	if (!c->blocks.bits && !c->blocks.uniform) {
+		if (c->surface) {
+			SDL_FreeSurface(c->surface);
+			c->surface = NULL;
 		}
+		return;
 	}
-	struct chunk *runner = firstChunk;
-	while (runner) {
-		x = runner->myX;
-		y = runner->myY;
-		for (i = 0; i < numRequired; i++) {
-			if (requiredChunks[i][0] == x && requiredChunks[i][1] == y) {
-				requiredChunks[i][0] = requiredChunks[--numRequired][0];
-				requiredChunks[i][1] = requiredChunks[numRequired][1];
-				break;
-			}
+	if (!c->surface)
+		c->surface = sgeCreateSDLSurface(BLOCKSIZE * CHUNKSIZE, BLOCKSIZE * CHUNKSIZE, screen->format->BitsPerPixel, 0);
+
+	chunkGetBlocks(c, &types[0][0]);
+	SDL_FillRect(c->surface, NULL, blockColors[BLOCK_AIR]);
+	r.y = 0;
+	for (i = 0; i < CHUNKSIZE; i++) {
+		r.x = 0;
+		for (j = 0; j < CHUNKSIZE; j++) {
+			if (types[i][j])
+				SDL_FillRect(c->surface, &r, blockColors[types[i][j]]);
+			r.x += BLOCKSIZE;
 		}
-		runner = runner->next;
+		r.y += BLOCKSIZE;
 	}
+}
 
-	for (i = 0; i < numRequired; i++)
-		generateChunk(requiredChunks[i][0], requiredChunks[i][1]);
+void drawChunk(struct chunk *c, void *data)
+{
+	SDL_Rect r;
 
-	SDL_Rect r = {.w = BLOCKSIZE, .h = BLOCKSIZE};
-	int baseX;
-	uint32_t color;
-	runner = firstChunk;
-	sgeClearScreen();
-	sgeLock(screen);
-
-	while (runner) {
-		r.y = (runner->myY - myPos.chunkY) * BLOCKSIZE * CHUNKSIZE - BLOCKSIZE * myPos.y / PRECISION + 250;
-		baseX = (runner->myX - myPos.chunkX) * BLOCKSIZE * CHUNKSIZE - BLOCKSIZE * myPos.x / PRECISION + 250;
-		color = (runner->myX + runner->myY) % 2 ? 0xFFFF0000 : 0xFF0000FF;
-		for (i = 0; i < CHUNKSIZE; i++) {
-			r.x = baseX;
-			for (j = 0; j < CHUNKSIZE; j++) {
-				if (runner->types[i][j])
-					SDL_FillRect(screen, &r, color);
-				r.x += BLOCKSIZE;
-			}
-			r.y += BLOCKSIZE;
-		}
-		runner = runner->next;
+	r.y = (c->myY - viewPos.chunkY) * BLOCKSIZE * CHUNKSIZE - BLOCKSIZE * viewPos.y / PRECISION + screen->h / 2;
+	r.x = (c->myX - viewPos.chunkX) * BLOCKSIZE * CHUNKSIZE - BLOCKSIZE * viewPos.x / PRECISION + screen->w / 2;
+	if (c->state != CHUNK_READY) {
+		// placeholder until the generator has published the chunk
+		sgeDrawRect(screen, r.x, r.y, BLOCKSIZE * CHUNKSIZE, BLOCKSIZE * CHUNKSIZE, 1, 0xFF404040);
+		return;
+	}
+	if (c->redraw) {
+		ZONE_BEGIN("renderChunk");
+		renderChunk(c);
+		ZONE_END();
 	}
-	r.x = 249;
-	r.y = 249;
+	if (c->surface) {
+		ZONE_BEGIN("SDL_BlitSurface");
+		SDL_BlitSurface(c->surface, NULL, screen, &r);
+		ZONE_END();
+	}
+}
+
+// only chunks overlapping the screen are drawn, see drawChunk for the mapping
+void drawVisibleChunks(void)
+{
+	int offsetX = BLOCKSIZE * viewPos.x / PRECISION - screen->w / 2;
+	int offsetY = BLOCKSIZE * viewPos.y / PRECISION - screen->h / 2;
+
+	chunkStoreForEachIn(&chunks,
+		viewPos.chunkX + floorDiv(offsetX, BLOCKSIZE * CHUNKSIZE),
+		viewPos.chunkY + floorDiv(offsetY, BLOCKSIZE * CHUNKSIZE),
+		viewPos.chunkX + floorDiv(offsetX + screen->w - 1, BLOCKSIZE * CHUNKSIZE),
+		viewPos.chunkY + floorDiv(offsetY + screen->h - 1, BLOCKSIZE * CHUNKSIZE),
+		drawChunk, NULL);
+}
+
+void onRedraw(SGEGAMESTATE *state)
+{
+	struct chunk *c;
+
+	if (residencyUpdate(&resident, myPos.chunkX, myPos.chunkY))
+		evictChunks();
+	for (c = genCollect(); c; c = c->next)
+		c->state = CHUNK_READY;
+
+	float alpha = gameLoopAlpha(&loop);
+	viewPos.chunkX = prevPos.chunkX;
+	viewPos.chunkY = prevPos.chunkY;
+	viewPos.x = prevPos.x + alpha * ((myPos.chunkX - prevPos.chunkX) * PRECISION * CHUNKSIZE + myPos.x - prevPos.x);
+	viewPos.y = prevPos.y + alpha * ((myPos.chunkY - prevPos.chunkY) * PRECISION * CHUNKSIZE + myPos.y - prevPos.y);
+	normalizePosition(&viewPos);
+
+	SDL_Rect r;
+	ZONE_BEGIN("sgeClearScreen");
+	sgeClearScreen();
+	ZONE_END();
+
+	// blits must not happen on a locked screen
+	drawVisibleChunks();
+
+	r.x = screen->w / 2 - 1;
+	r.y = screen->h / 2 - 1;
 	r.w = 3;
 	r.h = 3;
-	SDL_FillRect(screen, &r, (myPos.chunkX + myPos.chunkY) % 2 ? 0xFFFF8080 : 0xFF8080FF);
+	SDL_FillRect(screen, &r, (viewPos.chunkX + viewPos.chunkY) % 2 ? 0xFFFF8080 : 0xFF8080FF);
+
+	if (showOverlay && overlayFont) {
+		ZONE_BEGIN("sgeFontPrint");
+		profileDrawOverlay(overlayFont, screen, 4, 4);
+		ZONE_END();
+	}
+
+	frame++;
+	profileBegin(PROFILE_FLIP);
+	ZONE_BEGIN("sgeFlip");
+	if (!headless) {
+		sgeFlip();
+	} else if (dumpEvery && frame % dumpEvery == 0) {
+		char filename[MAXFILENAMELEN];
+		snprintf(filename, MAXFILENAMELEN, DUMPFILE, frame);
+		SDL_SaveBMP(screen, filename);
+	}
+	ZONE_END();
+	profileEnd(PROFILE_FLIP);
 
-	sgeUnlock(screen);
-	sgeFlip();
+	if (maxFrames && frame >= maxFrames)
+		sgeGameStateManagerQuit(state->manager);
 }
 
-int run(int argc, char **argv)
+void parseArgs(int argc, char **argv)
 {
-	srandom(time(NULL));
+	int i;
 
+	for (i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "--headless"))
+			headless = 1;
+		else if (!strcmp(argv[i], "--frames") && i + 1 < argc)
+			maxFrames = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--dump") && i + 1 < argc)
+			dumpEvery = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--autopilot"))
+			autopilot = 1;
+		else if (!strcmp(argv[i], "--world") && i + 1 < argc)
+			snprintf(worldDir, MAXFILENAMELEN, "%s", argv[++i]);
+		else if (!strcmp(argv[i], "--seed") && i + 1 < argc) {
+			fixedSeed = 1;
+			newSeed = strtoul(argv[++i], NULL, 0);
+		} else if (!strcmp(argv[i], "--radius") && i + 1 < argc)
+			loadRadius = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--record") && i + 1 < argc)
+			recordFile = argv[++i];
+		else if (!strcmp(argv[i], "--play") && i + 1 < argc)
+			playFile = argv[++i];
+		else
+			sgeBailOut(USAGE, argv[0]);
+	}
+	if (recordFile && playFile)
+		sgeBailOut(USAGE, argv[0]);
+}
+
+int run(int argc, char **argv)
+{
 	SGEGAMESTATEMANAGER *manager;
 	SGEGAMESTATE *game_state;
 
+	parseArgs(argc, argv);
+	// the dummy driver gives a plain offscreen surface of the requested size
+	if (headless)
+		setenv("SDL_VIDEODRIVER", "dummy", 1);
 	sgeInit(NOAUDIO, NOJOYSTICK);
 	sgeOpenScreen("Terraria ... in ... SPAAAAAAACE!!!", 500, 500, 32, NOFULLSCREEN);
 
 	game_state = sgeGameStateNew();
 	game_state->onKeyDown = keyFunc;
+	game_state->onKeyUp = keyUpFunc;
 	game_state->onRedraw = onRedraw;
 
 	myPos.chunkX = 0;
 	myPos.chunkY = 0;
 	myPos.x = CHUNKSIZE / 2 * PRECISION + PRECISION / 2;
 	myPos.y = CHUNKSIZE / 2 * PRECISION + PRECISION / 2;
+	prevPos = myPos;
 
-	struct chunk mine = {.myX = 0, .myY = 0, .next = NULL, .types={
+	struct chunk *mine = malloc(sizeof(struct chunk));
+	unsigned char spawn[CHUNKSIZE][CHUNKSIZE] = {
 		{1,0,0,0,0,0,0,0,0,1},
 		{0,0,0,0,0,0,0,0,0,0},
 		{0,0,0,1,0,1,0,1,0,0},
@@ -192,13 +562,70 @@ int run(int argc, char **argv)
 		{1,0,0,0,0,0,0,0,0,0},
 		{0,0,0,1,1,1,1,0,0,1},
 		{0,0,0,0,0,0,0,0,1,1},
-		{0,1,1,1,1,1,1,1,1,0}}};
-	firstChunk = &mine;
+		{0,1,1,1,1,1,1,1,1,0}};
+	mine->myX = 0;
+	mine->myY = 0;
+	mine->state = CHUNK_READY;
+	mine->surface = NULL;
+	chunkInitBlocks(mine, 0);
+	chunkSetBlocks(mine, &spawn[0][0]);
+	// the spawn can't be regenerated, it has to reach the region file
+	mine->dirty = 1;
+	chunkStoreInit(&chunks);
+	chunkStoreInsert(&chunks, mine);
+	residencyInit(&resident, LOADRADIUS, requireChunk, prefetchChunk, NULL);
+	residencySetRadius(&resident, loadRadius);
+	keepRadius = MAX(KEEPRADIUS, resident.radius + KEEPRADIUS - LOADRADIUS);
+	maxChunks = MAX(MAXCHUNKS, 2 * (2 * keepRadius + 1) * (2 * keepRadius + 1));
+	if (playFile) {
+		if (!replayPlay(&replay, playFile))
+			sgeBailOut("could not play %s\n", playFile);
+		if (replay.tickRate != TICKRATE)
+			sgeBailOut("%s was recorded at %u ticks per second\n", playFile, replay.tickRate);
+		autopilot = (replay.flags & REPLAY_AUTOPILOT) != 0;
+		snprintf(worldDir, MAXFILENAMELEN, REPLAYDIR);
+		if (!mkdtemp(worldDir))
+			sgeBailOut("could not create a world for %s\n", playFile);
+	}
+	regionStart(worldDir);
+	worldSeed = playFile ? replay.seed : readWorldSeed();
+	if (recordFile && !replayRecord(&replay, recordFile, worldSeed, TICKRATE, autopilot ? REPLAY_AUTOPILOT : 0))
+		sgeBailOut("could not record to %s\n", recordFile);
+	worldGenInit(worldSeed);
+	genStart(GENWORKERS, fillChunk);
+
+	if (access(DATAFILE, R_OK) == 0) {
+		data = sgeOpenFile(DATAFILE, DATAKEY);
+		overlayFont = sgeFontNewFileBitmap(data, OVERLAYFONT);
+	}
+	if (!overlayFont)
+		overlayFont = profileFont();
 
 	manager = sgeGameStateManagerNew();
 	sgeGameStateManagerChange(manager, game_state);
-	sgeGameStateManagerRun(manager, 30);
+	gameLoopInit(&loop, manager, TICKRATE, headless ? 0 : MAXFPS, onUpdate);
+	// unpaced runs would otherwise tick with the speed of the build
+	loop.fixedStep = headless;
+	if (replay.mode != REPLAY_OFF)
+		loop.replay = &replay;
+	gameLoopRun(&loop);
+	if (replay.mode != REPLAY_OFF)
+		replayClose(&replay, gameLoopTicks(&loop));
 
+	if (!profileDumpCSV(PROFILECSV))
+		fprintf(stderr, "could not write %s\n", PROFILECSV);
+	if (overlayFont)
+		sgeFontDestroy(overlayFont);
+	if (data)
+		sgeCloseFile(data);
+	chunkStoreForEach(&chunks, saveChunk, NULL);
+	regionStop();
+	genStop();
+	if (playFile)
+		removeWorld(worldDir);
+	worldGenDestroy();
+	if (!ZONE_EXPORT(ZONETRACE))
+		fprintf(stderr, "could not write %s\n", ZONETRACE);
 	sgeCloseScreen();
 	return 0;
 }
@@ -0,0 +1,82 @@
+#ifndef _NOISE_H
+#define _NOISE_H
+
+#define NOISE_SCALE_BITS 3
+#define NOISE_ONE 0x10000
+// blocks per noiseRow(), a whole number of vectors
+#define NOISE_ROW 16
+
+/*
+ * Deterministic noise keyed by the world seed and block coordinates.
+ * Every value is a pure function of its inputs and computed in integer
+ * arithmetic, so a chunk comes out the same on any thread, in any order
+ * and after being evicted and regenerated.
+ *
+ * Everything is inline so worldgen can keep whole rows in registers.
+ * noiseRow() hashes each lattice column once for the row instead of four
+ * times per block and does the interpolation in a fixed width loop that
+ * GCC vectorises at -O3, narrower rows would be unrolled into scalar code
+ * instead. It gives exactly the values noiseValue() does.
+ */
+
+// 3t^2 - 2t^3 for t = i / 8, in 1/256 steps
+static const int noiseSmooth[1 << NOISE_SCALE_BITS] = {0, 11, 40, 81, 128, 175, 216, 245};
+
+static inline unsigned int noiseHash(unsigned int seed, int x, int y)
+{
+	unsigned int h = seed ^ ((unsigned int)x * 0x9E3779B1u) ^ ((unsigned int)y * 0x85EBCA77u);
+	h ^= h >> 16;
+	h *= 0x7FEB352Du;
+	h ^= h >> 15;
+	h *= 0x846CA68Bu;
+	h ^= h >> 16;
+	return h;
+}
+
+static inline int noiseLerp(int a, int b, int w)
+{
+	return a + (((b - a) * w) >> 8);
+}
+
+// value noise in [0, NOISE_ONE) on a lattice of 1 << scaleBits blocks
+static inline int noiseValue(unsigned int seed, int x, int y, int scaleBits)
+{
+	int cx = x >> scaleBits, cy = y >> scaleBits;
+	int fx = (x & ((1 << scaleBits) - 1)) << (NOISE_SCALE_BITS - scaleBits);
+	int fy = (y & ((1 << scaleBits) - 1)) << (NOISE_SCALE_BITS - scaleBits);
+	int v00 = noiseHash(seed, cx, cy) & (NOISE_ONE - 1);
+	int v10 = noiseHash(seed, cx + 1, cy) & (NOISE_ONE - 1);
+	int v01 = noiseHash(seed, cx, cy + 1) & (NOISE_ONE - 1);
+	int v11 = noiseHash(seed, cx + 1, cy + 1) & (NOISE_ONE - 1);
+
+	return noiseLerp(noiseLerp(v00, v10, noiseSmooth[fx]), noiseLerp(v01, v11, noiseSmooth[fx]), noiseSmooth[fy]);
+}
+
+// noiseValue() for blocks x .. x + NOISE_ROW - 1 of row y
+static inline void noiseRow(unsigned int seed, int x, int y, int scaleBits, int out[NOISE_ROW])
+{
+	int cx = x >> scaleBits, cy = y >> scaleBits;
+	int cells = ((x + NOISE_ROW - 1) >> scaleBits) - cx + 2;
+	int fy = noiseSmooth[(y & ((1 << scaleBits) - 1)) << (NOISE_SCALE_BITS - scaleBits)];
+	int top[NOISE_ROW + 2], bottom[NOISE_ROW + 2];
+	int top0[NOISE_ROW], top1[NOISE_ROW], bottom0[NOISE_ROW], bottom1[NOISE_ROW], fx[NOISE_ROW];
+	int i, c;
+
+	for (i = 0; i < cells; i++) {
+		top[i] = noiseHash(seed, cx + i, cy) & (NOISE_ONE - 1);
+		bottom[i] = noiseHash(seed, cx + i, cy + 1) & (NOISE_ONE - 1);
+	}
+	// spread the lattice columns out to one entry per block
+	for (i = 0; i < NOISE_ROW; i++) {
+		c = ((x + i) >> scaleBits) - cx;
+		top0[i] = top[c];
+		top1[i] = top[c + 1];
+		bottom0[i] = bottom[c];
+		bottom1[i] = bottom[c + 1];
+		fx[i] = noiseSmooth[((x + i) & ((1 << scaleBits) - 1)) << (NOISE_SCALE_BITS - scaleBits)];
+	}
+	for (i = 0; i < NOISE_ROW; i++)
+		out[i] = noiseLerp(noiseLerp(top0[i], top1[i], fx[i]), noiseLerp(bottom0[i], bottom1[i], fx[i]), fy);
+}
+
+#endif
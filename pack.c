@@ -0,0 +1,409 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/random.h>
+#include "lz.h"
+#include "pack.h"
+
+#define PACK_MAGIC "PAK2"
+#define PACK_MAGICSALT "PAK3"
+#define PACK_LEGACYWORDS 4
+#define PACK_ENTRYWORDS 6
+
+static void packCrypt(void *buffer, Uint32 length, const char *key)
+{
+	if (key)
+		sgeEncryptBuffer(buffer, length, key);
+}
+
+// the data of an entry, in place
+static void packCryptEntry(struct pack *p, struct packentry *e, Uint8 *buffer)
+{
+	Uint32 nonce[3];
+
+	if (!(e->flags & PACK_CHACHA)) {
+		packCrypt(buffer, e->stored, p->key);
+		return;
+	}
+	nonce[0] = e->position;
+	nonce[1] = p->salt[0];
+	nonce[2] = p->salt[1];
+	cipherApply(&p->cipher, nonce, buffer, e->stored);
+}
+
+static Uint32 packWord(struct pack *p, size_t offset)
+{
+	Uint32 v;
+
+	memcpy(&v, p->map + offset, 4);
+	packCrypt(&v, 4, p->key);
+	return v;
+}
+
+static unsigned int packHash(const char *name)
+{
+	unsigned int h = 2166136261u;
+
+	while (*name)
+		h = (h ^ (unsigned char)*name++) * 16777619u;
+	return h ^ h >> 15;
+}
+
+// the first of several equally named entries wins, as with a linear search
+static void packHashEntries(struct pack *p)
+{
+	unsigned int mask, i;
+	int n;
+
+	for (p->lookupSize = 16; p->lookupSize < (unsigned int)p->numberOfFiles * 2; p->lookupSize *= 2)
+		;
+	mask = p->lookupSize - 1;
+	sgeMallocNoInit(p->lookup, int, p->lookupSize);
+	memset(p->lookup, -1, p->lookupSize * sizeof(int));
+	for (n = 0; n < p->numberOfFiles; n++) {
+		i = packHash(p->entries[n].name) & mask;
+		while (p->lookup[i] >= 0 && strcmp(p->entries[p->lookup[i]].name, p->entries[n].name))
+			i = (i + 1) & mask;
+		if (p->lookup[i] < 0)
+			p->lookup[i] = n;
+	}
+}
+
+static int packIndex(struct pack *p)
+{
+	size_t index, offset, trailer = p->mapSize;
+	Uint32 nameOffset, nameLength;
+	struct packentry *e;
+	int i, words = PACK_LEGACYWORDS;
+
+	if (trailer >= 8 && !memcmp(p->map + trailer - 4, PACK_MAGIC, 4)) {
+		trailer -= 4;
+		words = PACK_ENTRYWORDS;
+	} else if (trailer >= 16 && !memcmp(p->map + trailer - 4, PACK_MAGICSALT, 4)) {
+		trailer -= 4;
+		words = PACK_ENTRYWORDS;
+		p->salt[0] = packWord(p, trailer - 8);
+		p->salt[1] = packWord(p, trailer - 4);
+		trailer -= 8;
+	}
+	if (trailer < 4)
+		return 0;
+	p->numberOfFiles = packWord(p, trailer - 4);
+	if (p->numberOfFiles < 0 || (size_t)p->numberOfFiles > (trailer - 4) / (words * 4))
+		return 0;
+	index = trailer - 4 - p->numberOfFiles * words * 4;
+
+	sgeMalloc(p->entries, struct packentry, p->numberOfFiles + 1);
+	for (i = 0; i < p->numberOfFiles; i++) {
+		e = &p->entries[i];
+		offset = index + i * words * 4;
+		nameOffset = packWord(p, offset);
+		nameLength = packWord(p, offset + 4);
+		e->position = packWord(p, offset + 8);
+		e->stored = e->size = packWord(p, offset + 12);
+		if (words == PACK_ENTRYWORDS) {
+			e->size = packWord(p, offset + 16);
+			e->flags = packWord(p, offset + 20);
+		}
+		if (nameOffset > index || nameLength > index - nameOffset ||
+		    e->position > index || e->stored > index - e->position ||
+		    (!(e->flags & PACK_LZ) && e->stored != e->size) ||
+		    (e->flags & PACK_CHACHA && !p->key))
+			return 0;
+		sgeMalloc(p->entries[i].name, char, nameLength + 1);
+		memcpy(p->entries[i].name, p->map + nameOffset, nameLength);
+		packCrypt(p->entries[i].name, nameLength, p->key);
+	}
+	packHashEntries(p);
+	return 1;
+}
+
+struct pack *packOpen(const char *filename, const char *key)
+{
+	struct pack *p;
+	struct stat st;
+	void *map;
+	int fd;
+
+	fd = open(filename, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+	if (fstat(fd, &st) || !st.st_size) {
+		close(fd);
+		return NULL;
+	}
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return NULL;
+
+	sgeNew(p, struct pack);
+	p->map = map;
+	p->mapSize = st.st_size;
+	p->key = key && *key ? strdup(key) : NULL;
+	if (p->key)
+		cipherInit(&p->cipher, p->key);
+	if (!packIndex(p)) {
+		fprintf(stderr, "%s is damaged or the key is wrong\n", filename);
+		packClose(p);
+		return NULL;
+	}
+	return p;
+}
+
+void packClose(struct pack *p)
+{
+	int i;
+
+	if (p->entries) {
+		for (i = 0; i < p->numberOfFiles; i++)
+			sgeFree(p->entries[i].name);
+		sgeFree(p->entries);
+	}
+	sgeFree(p->lookup);
+	munmap((void *)p->map, p->mapSize);
+	sgeFree(p->key);
+	free(p);
+}
+
+int packFind(struct pack *p, const char *name)
+{
+	unsigned int mask = p->lookupSize - 1;
+	unsigned int i = packHash(name) & mask;
+
+	while (p->lookup[i] >= 0) {
+		if (!strcmp(p->entries[p->lookup[i]].name, name))
+			return p->lookup[i];
+		i = (i + 1) & mask;
+	}
+	return -1;
+}
+
+const void *packRead(struct pack *p, const char *name, Uint32 *size)
+{
+	struct packentry *e;
+	const Uint8 *packed;
+	Uint8 *data, *copy = NULL;
+	int i = packFind(p, name);
+
+	if (i < 0)
+		return NULL;
+	e = &p->entries[i];
+	*size = e->size;
+	if (!p->key && !(e->flags & PACK_LZ))
+		return p->map + e->position;
+
+	packed = p->map + e->position;
+	if (p->key && e->flags & PACK_LZ) {
+		sgeMallocNoInit(copy, Uint8, e->stored);
+		memcpy(copy, packed, e->stored);
+		packCryptEntry(p, e, copy);
+		packed = copy;
+	}
+	sgeMallocNoInit(data, Uint8, e->size + 1);
+	if (!(e->flags & PACK_LZ)) {
+		memcpy(data, packed, e->size);
+		packCryptEntry(p, e, data);
+	} else if (!lzDecompress(packed, e->stored, data, e->size)) {
+		fprintf(stderr, "damaged archive entry %s\n", name);
+		free(copy);
+		free(data);
+		return NULL;
+	}
+	free(copy);
+	data[e->size] = 0;
+	return data;
+}
+
+void packRelease(struct pack *p, const void *data)
+{
+	const Uint8 *d = data;
+
+	// views point into the mapping, everything else is a decrypted copy
+	if (d && (d < p->map || d >= p->map + p->mapSize))
+		free((void *)d);
+}
+
+SDL_Surface *packReadImage(struct pack *p, const char *name)
+{
+	SDL_Surface *loaded, *image;
+	const void *data;
+	Uint32 size;
+
+	data = packRead(p, name, &size);
+	if (!data)
+		return NULL;
+	loaded = IMG_Load_RW(SDL_RWFromConstMem(data, size), 1);
+	packRelease(p, data);
+	if (!loaded)
+		return NULL;
+	image = SDL_DisplayFormatAlpha(loaded);
+	SDL_FreeSurface(loaded);
+	return image;
+}
+
+Mix_Chunk *packReadSound(struct pack *p, const char *name)
+{
+	Mix_Chunk *sound;
+	const void *data;
+	Uint32 size;
+
+	data = packRead(p, name, &size);
+	if (!data)
+		return NULL;
+	// decodes into buffers of its own, the data is not needed afterwards
+	sound = Mix_LoadWAV_RW(SDL_RWFromConstMem(data, size), 1);
+	packRelease(p, data);
+	return sound;
+}
+
+static int packWriteWord(FILE *f, Uint32 v, const char *key)
+{
+	packCrypt(&v, 4, key);
+	return fwrite(&v, 4, 1, f) == 1;
+}
+
+static Uint8 *packReadFile(const char *filename, long *size)
+{
+	Uint8 *data;
+	FILE *in;
+	int ok;
+
+	in = fopen(filename, "rb");
+	if (!in || fseek(in, 0, SEEK_END) || (*size = ftell(in)) < 0 || fseek(in, 0, SEEK_SET)) {
+		fprintf(stderr, "could not read %s\n", filename);
+		if (in)
+			fclose(in);
+		return NULL;
+	}
+	sgeMallocNoInit(data, Uint8, *size + 1);
+	ok = *size == 0 || fread(data, *size, 1, in) == 1;
+	fclose(in);
+	if (!ok) {
+		fprintf(stderr, "could not read %s\n", filename);
+		free(data);
+		return NULL;
+	}
+	return data;
+}
+
+int packCreate(const char *filename, char *filenames[], int numberOfFiles, const char *key, int flags)
+{
+	struct packsource *sources;
+	int i, ok;
+
+	sgeMalloc(sources, struct packsource, numberOfFiles + 1);
+	for (i = 0; i < numberOfFiles; i++)
+		sources[i].name = filenames[i];
+	ok = packCreateSources(filename, sources, numberOfFiles, key, flags);
+	free(sources);
+	return ok;
+}
+
+// archives sharing a key must not share keystreams, so the salt has to be
+// unpredictable rather than merely different from run to run
+static int packSalt(Uint32 salt[2])
+{
+	int fd, ok;
+
+	if (getrandom(salt, 2 * sizeof(Uint32), 0) == 2 * sizeof(Uint32))
+		return 1;
+	fd = open("/dev/urandom", O_RDONLY);
+	if (fd < 0)
+		return 0;
+	ok = read(fd, salt, 2 * sizeof(Uint32)) == 2 * sizeof(Uint32);
+	close(fd);
+	return ok;
+}
+
+int packCreateSources(const char *filename, struct packsource *sources, int numberOfFiles, const char *key, int flags)
+{
+	int numWords;
+	struct cipher cipher;
+	Uint32 *words, *w, salt[2] = {0, 0}, nonce[3];
+	Uint8 *data, *packed;
+	Uint32 stored;
+	char *name;
+	FILE *f;
+	long size;
+	int i, ok = 1;
+
+	if (key && !*key)
+		key = NULL;
+	if (!key)
+		flags &= ~PACK_CIPHER;
+	numWords = flags & (PACK_COMPRESS | PACK_CIPHER) ? PACK_ENTRYWORDS : PACK_LEGACYWORDS;
+	if (flags & PACK_CIPHER) {
+		if (!packSalt(salt)) {
+			fprintf(stderr, "could not get random bytes for the salt of %s\n", filename);
+			return 0;
+		}
+		cipherInit(&cipher, key);
+	}
+	f = fopen(filename, "wb");
+	if (!f)
+		return 0;
+	sgeMalloc(words, Uint32, numberOfFiles * numWords + 1);
+	for (i = 0; ok && i < numberOfFiles; i++) {
+		if (sources[i].data) {
+			size = sources[i].size;
+			sgeMallocNoInit(data, Uint8, size + 1);
+			memcpy(data, sources[i].data, size);
+		} else if (!(data = packReadFile(sources[i].name, &size))) {
+			ok = 0;
+			break;
+		}
+		name = strdup(sources[i].name);
+
+		w = &words[i * numWords];
+		w[0] = ftell(f);
+		w[1] = strlen(name);
+		packCrypt(name, w[1], key);
+		ok = ok && fwrite(name, w[1], 1, f) == 1;
+
+		stored = 0;
+		if (flags & PACK_COMPRESS && size) {
+			sgeMallocNoInit(packed, Uint8, size);
+			stored = lzCompress(data, size, packed, size - 1);
+			if (stored) {
+				free(data);
+				data = packed;
+			} else {
+				free(packed);
+			}
+		}
+		w[2] = ftell(f);
+		w[3] = stored ? stored : size;
+		if (numWords == PACK_ENTRYWORDS) {
+			w[4] = size;
+			w[5] = (stored ? PACK_LZ : 0) | (flags & PACK_CIPHER ? PACK_CHACHA : 0);
+		}
+		if (flags & PACK_CIPHER) {
+			nonce[0] = w[2];
+			nonce[1] = salt[0];
+			nonce[2] = salt[1];
+			cipherApply(&cipher, nonce, data, w[3]);
+		} else {
+			packCrypt(data, w[3], key);
+		}
+		ok = ok && (w[3] == 0 || fwrite(data, w[3], 1, f) == 1);
+		free(name);
+		free(data);
+	}
+	for (i = 0; ok && i < numberOfFiles * numWords; i++)
+		ok = packWriteWord(f, words[i], key);
+	ok = ok && packWriteWord(f, numberOfFiles, key);
+	if (flags & PACK_CIPHER) {
+		ok = ok && packWriteWord(f, salt[0], key) && packWriteWord(f, salt[1], key);
+		ok = ok && fwrite(PACK_MAGICSALT, 4, 1, f) == 1;
+	} else if (numWords == PACK_ENTRYWORDS) {
+		ok = ok && fwrite(PACK_MAGIC, 4, 1, f) == 1;
+	}
+	free(words);
+	if (fclose(f) || !ok) {
+		remove(filename);
+		return 0;
+	}
+	return 1;
+}
@@ -0,0 +1,98 @@
+#ifndef _PACK_H
+#define _PACK_H
+
+#include <sge.h>
+#include "cipher.h"
+
+// packCreate() flags
+#define PACK_COMPRESS 1
+#define PACK_CIPHER 2
+
+// entry flags
+#define PACK_LZ 1
+#define PACK_CHACHA 2
+
+/*
+ * Read access to sge archives (as written by sga or sgeCreateFile()) that
+ * maps the whole archive once instead of seeking and reading every entry
+ * into a fresh buffer. Entries of an archive without a key are handed
+ * out as views into the mapping, encrypted ones are decrypted into a
+ * copy. Either way the result goes back through packRelease().
+ *
+ * The layout: every entry's name followed by its data, each encrypted
+ * on its own, then per entry the name offset, name length, data offset
+ * and size, then the number of entries, these five fields encrypted as
+ * 4 byte words.
+ *
+ * Revision 2 archives end in an unencrypted "PAK2" and store two more
+ * words per entry, the unpacked size and flags. Entries flagged PACK_LZ
+ * are compressed with lz.h before being encrypted, they are decoded from
+ * the mapping straight into the buffer handed out. Archives without the
+ * marker are read as before.
+ *
+ * Revision 3 archives end in "PAK3" instead, preceded by two encrypted
+ * salt words after the count, drawn from getrandom() for every archive. Their entries are flagged PACK_CHACHA,
+ * the data is encrypted with cipher.h using the entry's data offset and
+ * the salt as nonce rather than with sgeEncryptBuffer(). Names and the
+ * index keep the old scheme.
+ *
+ * Names are looked up through a hash table built when the archive is
+ * opened, so finding an entry costs the same in archives of any size.
+ */
+struct packentry {
+	char *name;
+	Uint32 position;
+	// bytes in the archive and after unpacking
+	Uint32 stored;
+	Uint32 size;
+	Uint32 flags;
+};
+
+struct pack {
+	const Uint8 *map;
+	size_t mapSize;
+	int numberOfFiles;
+	struct packentry *entries;
+	// open addressing over entry indices, -1 marks a free slot
+	int *lookup;
+	unsigned int lookupSize;
+	// NULL for unencrypted archives
+	char *key;
+	struct cipher cipher;
+	Uint32 salt[2];
+};
+
+// NULL if the archive can't be opened or the key doesn't fit it
+struct pack *packOpen(const char *filename, const char *key);
+void packClose(struct pack *p);
+
+// index of the entry called name, -1 if there is none
+int packFind(struct pack *p, const char *name);
+// NULL if there is no such entry
+const void *packRead(struct pack *p, const char *name, Uint32 *size);
+void packRelease(struct pack *p, const void *data);
+
+// decoded straight from the archive, like sgeReadImage() and sgeReadSound()
+SDL_Surface *packReadImage(struct pack *p, const char *name);
+Mix_Chunk *packReadSound(struct pack *p, const char *name);
+
+/*
+ * Like sgeCreateFile(), a NULL or empty key writes an unencrypted archive.
+ * Without flags the result is still readable by sgeOpenFile(), with
+ * PACK_COMPRESS it is a revision 2 archive and every entry that gets
+ * smaller is stored compressed. PACK_CIPHER writes a revision 3 archive,
+ * it has no effect without a key.
+ */
+int packCreate(const char *filename, char *filenames[], int numberOfFiles, const char *key, int flags);
+
+// an entry to write, data NULL reads the file called name
+struct packsource {
+	const char *name;
+	const void *data;
+	Uint32 size;
+};
+
+// like packCreate(), for entries that are partly built in memory
+int packCreateSources(const char *filename, struct packsource *sources, int numberOfFiles, const char *key, int flags);
+
+#endif
@@ -0,0 +1,57 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <sge.h>
+#include "atlas.h"
+#include "pack.h"
+
+#define USAGE "usage: %s [--compress] [--cipher] [--key key] archive [file ...] [--atlas image ...]\n"
+
+/*
+ * Writes an archive the game can read through pack.h.
+ * Usage: pack [--compress] [--cipher] [--key key] archive [file ...] [--atlas image ...]
+ * The files are stored under the names given. Everything after --atlas
+ * is an image packed into atlas pages instead, see atlas.h. --compress
+ * and --cipher set PACK_COMPRESS and PACK_CIPHER, the latter needs a key.
+ */
+int run(int argc, char **argv)
+{
+	const char *key = NULL, *archive = NULL;
+	char **files, **images;
+	int numFiles = 0, numImages = 0, flags = 0, atlas = 0, ok;
+	int i;
+
+	sgeMalloc(files, char *, argc);
+	sgeMalloc(images, char *, argc);
+	for (i = 1; i < argc; i++) {
+		if (atlas)
+			images[numImages++] = argv[i];
+		else if (!strcmp(argv[i], "--atlas"))
+			atlas = 1;
+		else if (!strcmp(argv[i], "--compress"))
+			flags |= PACK_COMPRESS;
+		else if (!strcmp(argv[i], "--cipher"))
+			flags |= PACK_CIPHER;
+		else if (!strcmp(argv[i], "--key") && i + 1 < argc)
+			key = argv[++i];
+		else if (argv[i][0] == '-')
+			sgeBailOut(USAGE, argv[0]);
+		else if (!archive)
+			archive = argv[i];
+		else
+			files[numFiles++] = argv[i];
+	}
+	if (!archive || (atlas && !numImages))
+		sgeBailOut(USAGE, argv[0]);
+	if ((flags & PACK_CIPHER) && (!key || !*key))
+		sgeBailOut("%s needs a key with --cipher\n", archive);
+
+	if (atlas)
+		ok = atlasCreate(archive, images, numImages, files, numFiles, key, flags);
+	else
+		ok = packCreate(archive, files, numFiles, key, flags);
+	if (!ok)
+		fprintf(stderr, "could not write %s\n", archive);
+	free(files);
+	free(images);
+	return !ok;
+}
@@ -0,0 +1,167 @@
+#include <unistd.h>
+#include "framesched.h"
+#include "profile.h"
+
+// the built-in font: 3x5 pixel glyphs, one bit per pixel from the top left,
+// drawn PROFILE_FONTSCALE times the size
+#define PROFILE_FONTCHARS " -.0123456789adefilmnoprstuvw"
+#define PROFILE_FONTSCALE 2
+#define PROFILE_GLYPHWIDTH (4 * PROFILE_FONTSCALE)
+#define PROFILE_GLYPHHEIGHT (6 * PROFILE_FONTSCALE)
+#define PROFILE_FONTDIR "/tmp/space-terraria-font-XXXXXX"
+#define PROFILE_FONTKEY "overlay"
+
+static const Uint16 fontGlyphs[] = {
+	0x0000, 0x01c0, 0x0002, 0x7b6f, 0x2c97, 0x73e7, 0x73cf, 0x5bc9,
+	0x79cf, 0x79ef, 0x7249, 0x7bef, 0x7bcf, 0x076b, 0x176b, 0x07e3,
+	0x39a4, 0x2092, 0x6493, 0x0ded, 0x0d6d, 0x056a, 0x0d74, 0x0ba4,
+	0x079e, 0x2e93, 0x0b6b, 0x0b6a, 0x0b7d,
+};
+
+static const char *phaseNames[PROFILE_PHASES] = {
+	"events", "update", "redraw", "flip", "frame"
+};
+
+static Uint64 started[PROFILE_PHASES];
+static Uint64 current[PROFILE_PHASES];
+static Uint64 lastFrame = 0;
+
+static Uint32 ring[PROFILE_FRAMES][PROFILE_PHASES];
+static volatile Uint32 frames = 0;
+
+void profileBegin(int phase)
+{
+	started[phase] = frameSchedNow();
+}
+
+void profileEnd(int phase)
+{
+	current[phase] += frameSchedNow() - started[phase];
+}
+
+void profileFrameEnd(void)
+{
+	Uint64 now = frameSchedNow();
+	Uint32 *slot = ring[frames % PROFILE_FRAMES];
+	int i;
+
+	current[PROFILE_FRAME] = lastFrame ? now - lastFrame : 0;
+	lastFrame = now;
+	for (i = 0; i < PROFILE_PHASES; i++) {
+		slot[i] = MIN(current[i], 0xFFFFFFFFull);
+		current[i] = 0;
+	}
+	__sync_fetch_and_add(&frames, 1);
+}
+
+static int profileCompare(const void *a, const void *b)
+{
+	Uint32 x = *(const Uint32 *)a, y = *(const Uint32 *)b;
+	return x < y ? -1 : x > y;
+}
+
+void profileGetStats(int phase, struct profilestats *stats)
+{
+	Uint32 sorted[PROFILE_FRAMES];
+	int count = MIN(frames, PROFILE_FRAMES);
+	int i;
+
+	memset(stats, 0, sizeof(struct profilestats));
+	if (!count)
+		return;
+	for (i = 0; i < count; i++)
+		sorted[i] = ring[i][phase];
+	qsort(sorted, count, sizeof(Uint32), profileCompare);
+	stats->p50 = sorted[count * 50 / 100] / 1000000.0;
+	stats->p95 = sorted[count * 95 / 100] / 1000000.0;
+	stats->p99 = sorted[count * 99 / 100] / 1000000.0;
+	stats->max = sorted[count - 1] / 1000000.0;
+}
+
+int profileDumpCSV(const char *filename)
+{
+	Uint32 total = frames;
+	Uint32 first = total > PROFILE_FRAMES ? total - PROFILE_FRAMES : 0;
+	Uint32 n;
+	FILE *f;
+	int i;
+
+	f = fopen(filename, "w");
+	if (!f)
+		return 0;
+	fprintf(f, "frame");
+	for (i = 0; i < PROFILE_PHASES; i++)
+		fprintf(f, ",%s_ms", phaseNames[i]);
+	fprintf(f, "\n");
+	for (n = first; n < total; n++) {
+		fprintf(f, "%u", n);
+		for (i = 0; i < PROFILE_PHASES; i++)
+			fprintf(f, ",%.3f", ring[n % PROFILE_FRAMES][i] / 1000000.0);
+		fprintf(f, "\n");
+	}
+	fclose(f);
+	return 1;
+}
+
+void profileDrawOverlay(SGEFONT *font, SDL_Surface *dest, int x, int y)
+{
+	struct profilestats stats;
+	char line[128];
+	int i;
+
+	for (i = 0; i < PROFILE_PHASES; i++) {
+		profileGetStats(i, &stats);
+		snprintf(line, sizeof(line), "%-6s %6.2f %6.2f %6.2f %6.2f",
+			phaseNames[i], stats.p50, stats.p95, stats.p99, stats.max);
+		sgeFontPrint(font, dest, x, y, line);
+		y += sgeFontGetLineHeight(font);
+	}
+}
+
+// libsge only loads bitmap fonts from an archive, so the glyphs take a
+// detour through a temporary one
+SGEFONT *profileFont(void)
+{
+	char dir[] = PROFILE_FONTDIR;
+	char image[sizeof(dir) + 16], map[sizeof(dir) + 16], archive[sizeof(dir) + 16];
+	char *files[] = {image, map};
+	int numChars = strlen(PROFILE_FONTCHARS);
+	SGEFONT *font = NULL;
+	SDL_Surface *s;
+	SGEFILE *f;
+	FILE *out;
+	int i, bit, x;
+
+	if (!mkdtemp(dir))
+		return NULL;
+	snprintf(image, sizeof(image), "%s/font.bmp", dir);
+	snprintf(map, sizeof(map), "%s/font.bmp.map", dir);
+	snprintf(archive, sizeof(archive), "%s/font.d", dir);
+
+	s = sgeCreateSDLSurface(numChars * (PROFILE_GLYPHWIDTH + 1), PROFILE_GLYPHHEIGHT, 32, 0);
+	for (i = 0; i < numChars; i++) {
+		x = i * (PROFILE_GLYPHWIDTH + 1);
+		for (bit = 0; bit < 15; bit++) {
+			if (fontGlyphs[i] & 1 << (14 - bit))
+				sgeFillRect(s, x + (bit % 3 + 1) * PROFILE_FONTSCALE, (bit / 3 + 1) * PROFILE_FONTSCALE,
+					PROFILE_FONTSCALE, PROFILE_FONTSCALE, 0xFFFFFFFF);
+		}
+		sgeFillRect(s, x + PROFILE_GLYPHWIDTH, 0, 1, PROFILE_GLYPHHEIGHT, 0xFFFF00FF);
+	}
+	SDL_SaveBMP(s, image);
+	SDL_FreeSurface(s);
+	out = fopen(map, "w");
+	if (out) {
+		fputs(PROFILE_FONTCHARS, out);
+		fclose(out);
+		sgeCreateFile(archive, files, 2, PROFILE_FONTKEY);
+		f = sgeOpenFile(archive, PROFILE_FONTKEY);
+		font = sgeFontNewFileBitmap(f, image);
+		sgeCloseFile(f);
+	}
+	unlink(archive);
+	unlink(image);
+	unlink(map);
+	rmdir(dir);
+	return font;
+}
@@ -0,0 +1,42 @@
+#ifndef _PROFILE_H
+#define _PROFILE_H
+
+#include <sge.h>
+
+#define PROFILE_EVENTS 0
+#define PROFILE_UPDATE 1
+// includes the flip
+#define PROFILE_REDRAW 2
+#define PROFILE_FLIP 3
+// from one profileFrameEnd() to the next
+#define PROFILE_FRAME 4
+#define PROFILE_PHASES 5
+
+#define PROFILE_FRAMES 1024
+
+/*
+ * Per frame phase timings. Phases are timed on the main thread between
+ * profileBegin() and profileEnd(), a phase entered several times in a
+ * frame adds up. profileFrameEnd() commits the frame to a ring buffer of
+ * the last PROFILE_FRAMES frames: the slot is written first and the
+ * frame counter published after it, so readers never lock and at worst
+ * see a slot that is being overwritten.
+ */
+struct profilestats {
+	// milliseconds
+	double p50, p95, p99, max;
+};
+
+void profileBegin(int phase);
+void profileEnd(int phase);
+void profileFrameEnd(void);
+
+void profileGetStats(int phase, struct profilestats *stats);
+// writes one line per recorded frame, returns 0 on failure
+int profileDumpCSV(const char *filename);
+void profileDrawOverlay(SGEFONT *font, SDL_Surface *dest, int x, int y);
+// a small font with just the characters the overlay uses, NULL on failure;
+// needs the screen to be open
+SGEFONT *profileFont(void);
+
+#endif
@@ -0,0 +1,336 @@
+#include <sge.h>
+#include "floordiv.h"
+#include "gen.h"
+#include "region.h"
+#include "zone.h"
+
+#define REGION_MAGIC "STRG"
+#define REGION_VERSION 1
+#define REGION_HEADER (4 + 4 + 4)
+#define REGION_TABLE (REGIONSIZE * REGIONSIZE * 2)
+#define REGION_MAXPAYLOAD (CHUNKSIZE * CHUNKSIZE * 2)
+// the world directory plus "/r.<x>.<y>.reg"
+#define REGION_NAMELEN (MAXFILENAMELEN + 32)
+
+#define IO_LOAD 0
+#define IO_SAVE 1
+
+struct iojob {
+	int type;
+	int x, y;
+	int prefetch;
+	struct chunk *c;
+	Uint32 length;
+	Uint8 payload[REGION_MAXPAYLOAD];
+	struct iojob *next;
+};
+
+struct region {
+	int x, y;
+	FILE *f;
+	Uint32 table[REGION_TABLE];
+	struct region *next;
+};
+
+static char worldDir[MAXFILENAMELEN];
+static SDL_mutex *lock;
+static SDL_cond *wake;
+static SDL_Thread *thread;
+static int quit = 0;
+static struct iojob *jobs = NULL, *jobsTail = NULL;
+// the job the I/O thread is working on
+static struct iojob *current = NULL;
+
+// only touched by the I/O thread
+static struct region *regions = NULL;
+
+static Uint32 regionEncode(struct chunk *c, Uint8 *out)
+{
+	Uint8 types[CHUNKSIZE * CHUNKSIZE];
+	Uint32 length = 0;
+	int i, run;
+
+	chunkGetBlocks(c, types);
+	for (i = 0; i < CHUNKSIZE * CHUNKSIZE; i += run) {
+		for (run = 1; i + run < CHUNKSIZE * CHUNKSIZE && run < 255; run++) {
+			if (types[i + run] != types[i])
+				break;
+		}
+		out[length++] = run;
+		out[length++] = types[i];
+	}
+	return length;
+}
+
+static int regionDecode(struct chunk *c, Uint8 *in, Uint32 length)
+{
+	Uint8 types[CHUNKSIZE * CHUNKSIZE];
+	int n = 0, run;
+	Uint32 i;
+
+	for (i = 0; i + 1 < length; i += 2) {
+		if (n + in[i] > CHUNKSIZE * CHUNKSIZE)
+			return 0;
+		for (run = 0; run < in[i]; run++)
+			types[n++] = in[i + 1];
+	}
+	if (n != CHUNKSIZE * CHUNKSIZE)
+		return 0;
+	chunkSetBlocks(c, types);
+	return 1;
+}
+
+static void regionClose(struct region *r)
+{
+	fclose(r->f);
+	free(r);
+}
+
+static struct region *regionOpen(int x, int y, int create)
+{
+	struct region *r, *prev = NULL;
+	char filename[REGION_NAMELEN], damaged[REGION_NAMELEN];
+	char magic[4];
+	Uint32 header[2];
+	int i, open = 0;
+
+	for (r = regions; r; prev = r, r = r->next) {
+		if (r->x == x && r->y == y) {
+			// move to the front, the list is kept most recently used first
+			if (prev) {
+				prev->next = r->next;
+				r->next = regions;
+				regions = r;
+			}
+			return r;
+		}
+		if (++open == REGION_MAXOPEN && r->next) {
+			regionClose(r->next);
+			r->next = NULL;
+		}
+	}
+
+	sgeNew(r, struct region);
+	r->x = x;
+	r->y = y;
+	snprintf(filename, REGION_NAMELEN, "%s/r.%d.%d.reg", worldDir, x, y);
+	r->f = fopen(filename, "r+b");
+	if (r->f) {
+		if (fread(magic, 4, 1, r->f) != 1 || memcmp(magic, REGION_MAGIC, 4) ||
+		    fread(header, sizeof(header), 1, r->f) != 1 ||
+		    sgeByteSwap32(header[0]) != REGION_VERSION ||
+		    sgeByteSwap32(header[1]) != REGIONSIZE ||
+		    fread(r->table, sizeof(r->table), 1, r->f) != 1) {
+			fclose(r->f);
+			r->f = NULL;
+			// moved aside rather than truncated, a fresh file takes its place
+			snprintf(damaged, REGION_NAMELEN, "%s/r.%d.%d.bad", worldDir, x, y);
+			if (rename(filename, damaged)) {
+				fprintf(stderr, "damaged region file %s could not be moved aside, not writing to it\n", filename);
+				free(r);
+				return NULL;
+			}
+			fprintf(stderr, "damaged region file %s kept as %s\n", filename, damaged);
+		} else {
+			for (i = 0; i < REGION_TABLE; i++)
+				r->table[i] = sgeByteSwap32(r->table[i]);
+		}
+	}
+	if (!r->f) {
+		if (!create) {
+			free(r);
+			return NULL;
+		}
+		r->f = fopen(filename, "w+b");
+		if (!r->f) {
+			fprintf(stderr, "could not create region file %s\n", filename);
+			free(r);
+			return NULL;
+		}
+		memset(r->table, 0, sizeof(r->table));
+		header[0] = sgeByteSwap32(REGION_VERSION);
+		header[1] = sgeByteSwap32(REGIONSIZE);
+		fwrite(REGION_MAGIC, 4, 1, r->f);
+		fwrite(header, sizeof(header), 1, r->f);
+		fwrite(r->table, sizeof(r->table), 1, r->f);
+	}
+	r->next = regions;
+	regions = r;
+	return r;
+}
+
+static void regionDoLoad(struct iojob *job)
+{
+	struct chunk *c = job->c;
+	struct region *r;
+	Uint8 payload[REGION_MAXPAYLOAD];
+	int index;
+
+	r = regionOpen(floorDiv(c->myX, REGIONSIZE), floorDiv(c->myY, REGIONSIZE), 0);
+	if (r) {
+		index = 2 * ((c->myY - r->y * REGIONSIZE) * REGIONSIZE + c->myX - r->x * REGIONSIZE);
+		if (r->table[index] && r->table[index + 1] <= REGION_MAXPAYLOAD &&
+		    fseek(r->f, r->table[index], SEEK_SET) == 0 &&
+		    fread(payload, r->table[index + 1], 1, r->f) == 1 &&
+		    regionDecode(c, payload, r->table[index + 1])) {
+			genPublish(c);
+			return;
+		}
+	}
+	// under the queue lock, so a regionPromote() is either seen here or
+	// finds the chunk in the generator's queue
+	SDL_LockMutex(lock);
+	genRequest(c, job->prefetch);
+	current = NULL;
+	SDL_UnlockMutex(lock);
+}
+
+static void regionDoSave(struct iojob *job)
+{
+	struct region *r;
+	Uint32 entry[2];
+	long offset;
+	int index;
+
+	r = regionOpen(floorDiv(job->x, REGIONSIZE), floorDiv(job->y, REGIONSIZE), 1);
+	if (!r)
+		return;
+	index = 2 * ((job->y - r->y * REGIONSIZE) * REGIONSIZE + job->x - r->x * REGIONSIZE);
+	// overwrite the old payload in place if the new one fits, else append
+	if (r->table[index] && job->length <= r->table[index + 1])
+		offset = r->table[index];
+	else
+		offset = fseek(r->f, 0, SEEK_END) ? -1 : ftell(r->f);
+	if (offset < 0 || fseek(r->f, offset, SEEK_SET) ||
+	    fwrite(job->payload, job->length, 1, r->f) != 1) {
+		fprintf(stderr, "could not save chunk %d,%d\n", job->x, job->y);
+		return;
+	}
+	r->table[index] = offset;
+	r->table[index + 1] = job->length;
+	entry[0] = sgeByteSwap32(r->table[index]);
+	entry[1] = sgeByteSwap32(r->table[index + 1]);
+	fseek(r->f, REGION_HEADER + index * sizeof(Uint32), SEEK_SET);
+	fwrite(entry, sizeof(entry), 1, r->f);
+}
+
+static int regionWorker(void *data)
+{
+	struct iojob *job;
+
+	for (;;) {
+		SDL_LockMutex(lock);
+		while (!quit && !jobs)
+			SDL_CondWait(wake, lock);
+		job = jobs;
+		if (!job) {
+			SDL_UnlockMutex(lock);
+			break;
+		}
+		jobs = job->next;
+		if (!jobs)
+			jobsTail = NULL;
+		current = job;
+		SDL_UnlockMutex(lock);
+
+		if (job->type == IO_LOAD) {
+			ZONE_BEGIN("regionLoad");
+			regionDoLoad(job);
+			ZONE_END();
+		} else {
+			ZONE_BEGIN("regionSave");
+			regionDoSave(job);
+			ZONE_END();
+		}
+		SDL_LockMutex(lock);
+		current = NULL;
+		SDL_UnlockMutex(lock);
+		free(job);
+	}
+
+	while (regions) {
+		struct region *r = regions;
+		regions = r->next;
+		regionClose(r);
+	}
+	return 0;
+}
+
+static void regionQueue(struct iojob *job)
+{
+	SDL_LockMutex(lock);
+	job->next = NULL;
+	if (jobsTail)
+		jobsTail->next = job;
+	else
+		jobs = job;
+	jobsTail = job;
+	SDL_CondSignal(wake);
+	SDL_UnlockMutex(lock);
+}
+
+void regionStart(const char *dir)
+{
+	snprintf(worldDir, MAXFILENAMELEN, "%s", dir);
+	mkdir(worldDir, 0755);
+	quit = 0;
+	lock = SDL_CreateMutex();
+	wake = SDL_CreateCond();
+	thread = SDL_CreateThread(regionWorker, NULL);
+	if (!thread)
+		sgeBailOut("could not start region I/O thread: %s\n", SDL_GetError());
+}
+
+void regionStop(void)
+{
+	SDL_LockMutex(lock);
+	quit = 1;
+	SDL_CondSignal(wake);
+	SDL_UnlockMutex(lock);
+	SDL_WaitThread(thread, NULL);
+	SDL_DestroyCond(wake);
+	SDL_DestroyMutex(lock);
+}
+
+void regionLoad(struct chunk *c, int prefetch)
+{
+	struct iojob *job;
+
+	sgeNew(job, struct iojob);
+	job->type = IO_LOAD;
+	job->c = c;
+	job->prefetch = prefetch;
+	regionQueue(job);
+}
+
+void regionPromote(struct chunk *c)
+{
+	struct iojob *job;
+
+	SDL_LockMutex(lock);
+	for (job = jobs; job; job = job->next) {
+		if (job->type == IO_LOAD && job->c == c)
+			break;
+	}
+	if (!job && current && current->type == IO_LOAD && current->c == c)
+		job = current;
+	if (job)
+		job->prefetch = 0;
+	SDL_UnlockMutex(lock);
+	// already passed on to the generator
+	if (!job)
+		genPromote(c);
+}
+
+void regionSave(struct chunk *c)
+{
+	struct iojob *job;
+
+	sgeMallocNoInit(job, struct iojob, 1);
+	job->type = IO_SAVE;
+	job->x = c->myX;
+	job->y = c->myY;
+	job->length = regionEncode(c, job->payload);
+	c->dirty = 0;
+	regionQueue(job);
+}
@@ -0,0 +1,47 @@
+#ifndef _REGION_H
+#define _REGION_H
+
+#include "chunk.h"
+
+#define REGIONSIZE 16
+#define REGION_MAXOPEN 8
+
+/*
+ * On disk chunk persistence. Chunks are grouped into region files of
+ * REGIONSIZE x REGIONSIZE chunks, named r.<x>.<y>.reg inside the world
+ * directory:
+ *
+ *   char   magic[4]     "STRG"
+ *   Uint32 version
+ *   Uint32 regionsize
+ *   Uint32 offset, length  (REGIONSIZE * REGIONSIZE entries, row major)
+ *   ...    payloads
+ *
+ * All numbers are little endian. A payload is the chunk's blocks run
+ * length encoded as (count, type) byte pairs. A rewritten chunk goes
+ * over its old payload if it fits and is appended otherwise, either way
+ * its table entry is updated. Only dirty chunks are written, unchanged
+ * ones regenerate from the seed or are already on disk. A file with a
+ * bad header is renamed to r.<x>.<y>.bad and replaced by an empty one,
+ * its chunks regenerate.
+ *
+ * All file access happens on a dedicated I/O thread which keeps the
+ * offset tables of the last REGION_MAXOPEN regions in memory, so loading
+ * a chunk costs one seek and one read.
+ */
+void regionStart(const char *dir);
+// finishes all queued saves before returning
+void regionStop(void);
+
+/*
+ * Look up the chunk on disk. If it was saved it is filled from the region
+ * file and handed to genPublish(), otherwise it is passed on to the
+ * generator with genRequest(c, prefetch).
+ */
+void regionLoad(struct chunk *c, int prefetch);
+// makes a prefetch required, whether it still waits for the disk or the generator
+void regionPromote(struct chunk *c);
+// encodes the chunk right away, the caller may free it after this returns
+void regionSave(struct chunk *c);
+
+#endif
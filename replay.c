@@ -0,0 +1,230 @@
+#include "replay.h"
+
+#define REPLAY_MAGIC "STRP"
+// version 1 had no flags
+#define REPLAY_VERSION 2
+
+static void replayPut16(FILE *f, Uint16 v)
+{
+	fputc(v & 0xFF, f);
+	fputc(v >> 8, f);
+}
+
+static Uint16 replayGet16(FILE *f)
+{
+	Uint16 v = fgetc(f);
+	return v | fgetc(f) << 8;
+}
+
+static void replayPut32(FILE *f, Uint32 v)
+{
+	replayPut16(f, v & 0xFFFF);
+	replayPut16(f, v >> 16);
+}
+
+static Uint32 replayGet32(FILE *f)
+{
+	Uint32 v = replayGet16(f);
+	return v | (Uint32)replayGet16(f) << 16;
+}
+
+static void replayPutDelta(FILE *f, Uint32 v)
+{
+	while (v >= 0x80) {
+		fputc((v & 0x7F) | 0x80, f);
+		v >>= 7;
+	}
+	fputc(v, f);
+}
+
+static int replayGetDelta(FILE *f, Uint32 *v)
+{
+	int c, shift = 0;
+
+	*v = 0;
+	do {
+		if ((c = fgetc(f)) == EOF || shift > 28)
+			return 0;
+		*v |= (Uint32)(c & 0x7F) << shift;
+		shift += 7;
+	} while (c & 0x80);
+	return 1;
+}
+
+int replayRecord(struct replay *r, const char *filename, Uint32 seed, Uint32 tickRate, Uint32 flags)
+{
+	memset(r, 0, sizeof(struct replay));
+	r->f = fopen(filename, "wb");
+	if (!r->f)
+		return 0;
+	r->mode = REPLAY_RECORD;
+	r->seed = seed;
+	r->tickRate = tickRate;
+	r->flags = flags;
+	fwrite(REPLAY_MAGIC, 4, 1, r->f);
+	replayPut32(r->f, REPLAY_VERSION);
+	replayPut32(r->f, seed);
+	replayPut32(r->f, tickRate);
+	replayPut32(r->f, flags);
+	return 1;
+}
+
+static int replayReadEvent(struct replay *r)
+{
+	SGEEVENT *e = &r->next;
+	Uint32 delta;
+	int type;
+
+	r->pending = 0;
+	if (!replayGetDelta(r->f, &delta) || (type = fgetc(r->f)) == EOF)
+		return 0;
+	memset(e, 0, sizeof(SGEEVENT));
+	e->type = type;
+	switch (type) {
+	case SDL_NOEVENT:
+		r->end = r->tick + delta;
+		return 0;
+	case SDL_KEYDOWN:
+	case SDL_KEYUP:
+		e->key.state = type == SDL_KEYDOWN ? SDL_PRESSED : SDL_RELEASED;
+		e->key.keysym.sym = replayGet16(r->f);
+		e->key.keysym.mod = replayGet16(r->f);
+		break;
+	case SDL_MOUSEBUTTONDOWN:
+	case SDL_MOUSEBUTTONUP:
+		e->button.state = type == SDL_MOUSEBUTTONDOWN ? SDL_PRESSED : SDL_RELEASED;
+		e->button.button = fgetc(r->f);
+		e->button.x = replayGet16(r->f);
+		e->button.y = replayGet16(r->f);
+		break;
+	case SDL_MOUSEMOTION:
+		e->motion.state = fgetc(r->f);
+		e->motion.x = replayGet16(r->f);
+		e->motion.y = replayGet16(r->f);
+		e->motion.xrel = replayGet16(r->f);
+		e->motion.yrel = replayGet16(r->f);
+		break;
+	case SDL_JOYBUTTONDOWN:
+	case SDL_JOYBUTTONUP:
+		e->jbutton.state = type == SDL_JOYBUTTONDOWN ? SDL_PRESSED : SDL_RELEASED;
+		e->jbutton.which = fgetc(r->f);
+		e->jbutton.button = fgetc(r->f);
+		break;
+	case SDL_JOYAXISMOTION:
+		e->jaxis.which = fgetc(r->f);
+		e->jaxis.axis = fgetc(r->f);
+		e->jaxis.value = replayGet16(r->f);
+		break;
+	default:
+		fprintf(stderr, "damaged replay, unknown event %d\n", type);
+		return 0;
+	}
+	if (feof(r->f))
+		return 0;
+	r->tick += delta;
+	r->pending = 1;
+	return 1;
+}
+
+int replayPlay(struct replay *r, const char *filename)
+{
+	char magic[4];
+	Uint32 version = 0;
+
+	memset(r, 0, sizeof(struct replay));
+	r->f = fopen(filename, "rb");
+	if (!r->f)
+		return 0;
+	if (fread(magic, 4, 1, r->f) == 1 && !memcmp(magic, REPLAY_MAGIC, 4))
+		version = replayGet32(r->f);
+	if (version < 1 || version > REPLAY_VERSION) {
+		fclose(r->f);
+		r->f = NULL;
+		return 0;
+	}
+	r->mode = REPLAY_PLAY;
+	r->seed = replayGet32(r->f);
+	r->tickRate = replayGet32(r->f);
+	if (version >= 2)
+		r->flags = replayGet32(r->f);
+	replayReadEvent(r);
+	return 1;
+}
+
+void replayClose(struct replay *r, Uint32 tick)
+{
+	if (r->mode == REPLAY_RECORD) {
+		replayPutDelta(r->f, tick - r->tick);
+		fputc(SDL_NOEVENT, r->f);
+	}
+	if (r->f)
+		fclose(r->f);
+	r->f = NULL;
+	r->mode = REPLAY_OFF;
+}
+
+void replayWrite(struct replay *r, Uint32 tick, SGEEVENT *event)
+{
+	FILE *f = r->f;
+
+	switch (event->type) {
+	case SDL_KEYDOWN:
+	case SDL_KEYUP:
+	case SDL_MOUSEBUTTONDOWN:
+	case SDL_MOUSEBUTTONUP:
+	case SDL_MOUSEMOTION:
+	case SDL_JOYBUTTONDOWN:
+	case SDL_JOYBUTTONUP:
+	case SDL_JOYAXISMOTION:
+		break;
+	default:
+		return;
+	}
+	replayPutDelta(f, tick - r->tick);
+	r->tick = tick;
+	fputc(event->type, f);
+	switch (event->type) {
+	case SDL_KEYDOWN:
+	case SDL_KEYUP:
+		replayPut16(f, event->key.keysym.sym);
+		replayPut16(f, event->key.keysym.mod);
+		break;
+	case SDL_MOUSEBUTTONDOWN:
+	case SDL_MOUSEBUTTONUP:
+		fputc(event->button.button, f);
+		replayPut16(f, event->button.x);
+		replayPut16(f, event->button.y);
+		break;
+	case SDL_MOUSEMOTION:
+		fputc(event->motion.state, f);
+		replayPut16(f, event->motion.x);
+		replayPut16(f, event->motion.y);
+		replayPut16(f, event->motion.xrel);
+		replayPut16(f, event->motion.yrel);
+		break;
+	case SDL_JOYBUTTONDOWN:
+	case SDL_JOYBUTTONUP:
+		fputc(event->jbutton.which, f);
+		fputc(event->jbutton.button, f);
+		break;
+	case SDL_JOYAXISMOTION:
+		fputc(event->jaxis.which, f);
+		fputc(event->jaxis.axis, f);
+		replayPut16(f, event->jaxis.value);
+		break;
+	}
+}
+
+int replayRead(struct replay *r, Uint32 tick, SGEEVENT *event)
+{
+	if (!r->pending || r->tick > tick)
+		return 0;
+	*event = r->next;
+	replayReadEvent(r);
+	return 1;
+}
+
+int replayFinished(struct replay *r, Uint32 tick)
+{
+	return !r->pending && tick >= r->end;
+}
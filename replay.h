@@ -0,0 +1,57 @@
+#ifndef _REPLAY_H
+#define _REPLAY_H
+
+#include <sge.h>
+
+#define REPLAY_OFF 0
+#define REPLAY_RECORD 1
+#define REPLAY_PLAY 2
+
+// session options stored with the recording
+#define REPLAY_AUTOPILOT 1
+
+/*
+ * Input recordings for rerunning a session. The file starts with the
+ * world seed, tick rate and the REPLAY_ session flags, followed by the
+ * input events, each stamped
+ * with the simulation tick it was dispatched before, and an end marker
+ * with the last tick. Ticks are stored as variable length deltas, so a
+ * record is usually 3 to 7 bytes.
+ *
+ * Played back events go through the normal dispatch right before their
+ * tick, so the simulation sees the same input at the same ticks no
+ * matter how fast frames are drawn. Chunk streaming is not captured,
+ * instead every tick of a recorded or played session waits for the
+ * chunks the player can touch, so a still loading chunk never blocks
+ * movement in one run and not in the other. Playback starts from an
+ * empty world, which the seed regenerates exactly.
+ */
+struct replay {
+	int mode;
+	FILE *f;
+	Uint32 seed;
+	Uint32 tickRate;
+	Uint32 flags;
+
+	/** @privatesection */
+	Uint32 tick;
+	Uint32 end;
+	// playback reads one event ahead
+	int pending;
+	SGEEVENT next;
+};
+
+// both return 0 if the file can't be opened or isn't a recording
+int replayRecord(struct replay *r, const char *filename, Uint32 seed, Uint32 tickRate, Uint32 flags);
+int replayPlay(struct replay *r, const char *filename);
+// a recording ends at tick, playback ignores it
+void replayClose(struct replay *r, Uint32 tick);
+
+// input events only, anything else is ignored
+void replayWrite(struct replay *r, Uint32 tick, SGEEVENT *event);
+// returns 1 and fills event while there are events due before tick
+int replayRead(struct replay *r, Uint32 tick, SGEEVENT *event);
+// all events played and the recording's last tick reached
+int replayFinished(struct replay *r, Uint32 tick);
+
+#endif
@@ -0,0 +1,66 @@
+#include <stdlib.h>
+#include "residency.h"
+
+void residencyInit(struct residency *r, int radius, void (*require)(int x, int y, void *data), void (*prefetch)(int x, int y, void *data), void *data)
+{
+	r->centreX = 0;
+	r->centreY = 0;
+	r->radius = radius;
+	r->valid = 0;
+	r->require = require;
+	r->prefetch = prefetch;
+	r->data = data;
+}
+
+void residencySetRadius(struct residency *r, int radius)
+{
+	if (radius < 0)
+		radius = 0;
+	if (radius == r->radius)
+		return;
+	r->radius = radius;
+	r->valid = 0;
+}
+
+int residencyContains(struct residency *r, int x, int y)
+{
+	return r->valid && abs(x - r->centreX) <= r->radius && abs(y - r->centreY) <= r->radius;
+}
+
+static void residencyPrefetch(struct residency *r, int dx, int dy)
+{
+	int ring = r->radius + 1;
+	int x, y;
+
+	for (y = -ring; y <= ring; y++) {
+		for (x = -ring; x <= ring; x++) {
+			if (abs(x) != ring && abs(y) != ring)
+				continue;
+			if ((dx > 0 && x == ring) || (dx < 0 && x == -ring) ||
+			    (dy > 0 && y == ring) || (dy < 0 && y == -ring))
+				r->prefetch(r->centreX + x, r->centreY + y, r->data);
+		}
+	}
+}
+
+int residencyUpdate(struct residency *r, int chunkX, int chunkY)
+{
+	struct residency old = *r;
+	int x, y;
+
+	if (r->valid && r->centreX == chunkX && r->centreY == chunkY)
+		return 0;
+
+	r->centreX = chunkX;
+	r->centreY = chunkY;
+	r->valid = 1;
+	for (y = chunkY - r->radius; y <= chunkY + r->radius; y++) {
+		for (x = chunkX - r->radius; x <= chunkX + r->radius; x++) {
+			if (!residencyContains(&old, x, y))
+				r->require(x, y, r->data);
+		}
+	}
+	if (old.valid && r->prefetch)
+		residencyPrefetch(r, chunkX - old.centreX, chunkY - old.centreY);
+	return 1;
+}
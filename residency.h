@@ -0,0 +1,30 @@
+#ifndef _RESIDENCY_H
+#define _RESIDENCY_H
+
+/*
+ * Tracks the chunk the player is centred on and the square of chunks
+ * within radius of it that must be resident. The required set is only
+ * recomputed when the centre moves to another chunk or the radius
+ * changes, and only chunks that newly entered the set are reported.
+ *
+ * When the centre moves, the ring just outside the radius on the side
+ * the player is heading to is reported to prefetch, so those chunks can
+ * be generated before they are needed.
+ */
+struct residency {
+	int centreX, centreY;
+	int radius;
+	int valid;
+	void (*require)(int x, int y, void *data);
+	void (*prefetch)(int x, int y, void *data);
+	void *data;
+};
+
+void residencyInit(struct residency *r, int radius, void (*require)(int x, int y, void *data), void (*prefetch)(int x, int y, void *data), void *data);
+void residencySetRadius(struct residency *r, int radius);
+int residencyContains(struct residency *r, int x, int y);
+
+// returns 1 if the centre changed and require/prefetch were called, 0 otherwise
+int residencyUpdate(struct residency *r, int chunkX, int chunkY);
+
+#endif
@@ -0,0 +1,227 @@
+#include <sge.h>
+#include "floordiv.h"
+#include "noise.h"
+#include "worldgen.h"
+
+#define SECTORBLOCKS (SECTORSIZE * CHUNKSIZE)
+#define HALO (CHUNKSIZE + 2)
+// keeps every planet this far from the sector edge: 3 blocks of surface
+// noise and the 1 block halo, so terrain never crosses into a sector
+// that doesn't know about the planet
+#define PLANET_MARGIN 4
+
+#if HALO > NOISE_ROW
+#error "a noise row must cover the chunk halo"
+#endif
+
+#define SALT_PLANET 0x504C4E54u
+#define SALT_BIOME 0x42494F4Du
+#define SALT_SURFACE 0x53524643u
+#define SALT_CAVE 0x43415645u
+#define SALT_DECORATION 0x4445434Fu
+
+struct planet {
+	// centre in world block coordinates
+	int x, y;
+	int radius;
+	int biome;
+};
+
+struct sector {
+	int x, y;
+	int valid;
+	unsigned int lastUsed;
+	int numPlanets;
+	struct planet planets[SECTOR_MAXPLANETS];
+	unsigned char biomes[SECTORSIZE][SECTORSIZE];
+};
+
+static const unsigned char biomeFiller[BIOMES] = {
+	BLOCK_STONE, BLOCK_STONE, BLOCK_ICE, BLOCK_SAND, BLOCK_DIRT
+};
+
+static const unsigned char biomeCover[BIOMES] = {
+	BLOCK_STONE, BLOCK_STONE, BLOCK_SNOW, BLOCK_SAND, BLOCK_GRASS
+};
+
+static unsigned int seed;
+static SDL_mutex *lock;
+static struct sector cache[WORLDGEN_CACHE];
+static unsigned int useCounter = 0;
+
+// stage 1
+static void layoutPlanets(struct sector *s)
+{
+	unsigned int h = noiseHash(seed ^ SALT_PLANET, s->x, s->y);
+	struct planet *p;
+	int i, extent;
+
+	s->numPlanets = 1 + h % SECTOR_MAXPLANETS;
+	for (i = 0; i < s->numPlanets; i++) {
+		p = &s->planets[i];
+		h = noiseHash(seed ^ SALT_PLANET, s->x * SECTOR_MAXPLANETS + i + 1, s->y);
+		p->radius = 20 + h % 41;
+		h = noiseHash(h, 1, 0);
+		extent = p->radius + PLANET_MARGIN;
+		p->x = s->x * SECTORBLOCKS + extent + h % (SECTORBLOCKS - 2 * extent);
+		h = noiseHash(h, 0, 1);
+		p->y = s->y * SECTORBLOCKS + extent + h % (SECTORBLOCKS - 2 * extent);
+		p->biome = BIOME_ROCK + noiseHash(h, 1, 1) % (BIOMES - 1);
+	}
+}
+
+// stage 2
+static void assignBiomes(struct sector *s)
+{
+	struct planet *p;
+	int i, j, k;
+	int chunkX, chunkY, dx, dy, reach;
+
+	for (j = 0; j < SECTORSIZE; j++) {
+		for (i = 0; i < SECTORSIZE; i++) {
+			chunkX = s->x * SECTORSIZE + i;
+			chunkY = s->y * SECTORSIZE + j;
+			s->biomes[j][i] = BIOME_SPACE;
+			for (k = 0; k < s->numPlanets; k++) {
+				p = &s->planets[k];
+				dx = chunkX * CHUNKSIZE + CHUNKSIZE / 2 - p->x;
+				dy = chunkY * CHUNKSIZE + CHUNKSIZE / 2 - p->y;
+				reach = p->radius + CHUNKSIZE;
+				if (dx * dx + dy * dy >= reach * reach)
+					continue;
+				s->biomes[j][i] = p->biome;
+				// patches of a neighbouring biome, always whole chunks
+				if (noiseValue(seed ^ SALT_BIOME, chunkX, chunkY, 2) > NOISE_ONE * 3 / 4)
+					s->biomes[j][i] = BIOME_ROCK + p->biome % (BIOMES - 1);
+				break;
+			}
+		}
+	}
+}
+
+// copies the sector out of the cache, computing stages 1 and 2 on a miss
+static void getSector(int x, int y, struct sector *out)
+{
+	struct sector *s, *victim = &cache[0];
+	int i;
+
+	SDL_LockMutex(lock);
+	for (i = 0; i < WORLDGEN_CACHE; i++) {
+		s = &cache[i];
+		if (s->valid && s->x == x && s->y == y)
+			break;
+		if (!s->valid || (victim->valid && s->lastUsed < victim->lastUsed))
+			victim = s;
+	}
+	if (i == WORLDGEN_CACHE) {
+		s = victim;
+		s->x = x;
+		s->y = y;
+		layoutPlanets(s);
+		assignBiomes(s);
+		s->valid = 1;
+	}
+	s->lastUsed = ++useCounter;
+	*out = *s;
+	SDL_UnlockMutex(lock);
+}
+
+// stage 3, also fills a one block halo so decoration can see neighbours
+static void fillTerrain(struct sector *s, int chunkX, int chunkY, int biome, unsigned char types[HALO][HALO])
+{
+	int surface[NOISE_ROW], cave[NOISE_ROW];
+	long long d2[HALO], outer[HALO];
+	unsigned char filler;
+	struct planet *p;
+	int baseX = chunkX * CHUNKSIZE - 1, baseY = chunkY * CHUNKSIZE - 1;
+	int x, y, k, dx, dy, reach;
+
+	memset(types, BLOCK_AIR, HALO * HALO);
+	// most chunks are open space, skip the noise unless the halo comes
+	// within the margin of a planet, which covers the surface noise
+	for (k = 0; k < s->numPlanets; k++) {
+		p = &s->planets[k];
+		dx = p->x < baseX ? baseX - p->x : MAX(p->x - (baseX + HALO - 1), 0);
+		dy = p->y < baseY ? baseY - p->y : MAX(p->y - (baseY + HALO - 1), 0);
+		reach = p->radius + PLANET_MARGIN;
+		if (dx * dx + dy * dy < reach * reach)
+			break;
+	}
+	if (k == s->numPlanets)
+		return;
+
+	for (y = 0; y < HALO; y++) {
+		noiseRow(seed ^ SALT_SURFACE, baseX, baseY + y, 2, surface);
+		noiseRow(seed ^ SALT_CAVE, baseX, baseY + y, 3, cave);
+		for (k = 0; k < s->numPlanets; k++) {
+			p = &s->planets[k];
+			filler = biomeFiller[biome != BIOME_SPACE ? biome : p->biome];
+			dy = baseY + y - p->y;
+			// distances in 1/256 blocks, the surface varies by +-3 blocks
+			for (x = 0; x < HALO; x++) {
+				d2[x] = ((long long)(baseX + x - p->x) * (baseX + x - p->x) + (long long)dy * dy) << 16;
+				outer[x] = p->radius * 256 + (surface[x] - NOISE_ONE / 2) * 6 / 256;
+				outer[x] *= outer[x];
+			}
+			for (x = 0; x < HALO; x++) {
+				if (d2[x] < outer[x] && cave[x] < NOISE_ONE * 11 / 16)
+					types[y][x] = filler;
+			}
+		}
+	}
+}
+
+// stage 4
+static void decorate(int chunkX, int chunkY, int biome, unsigned char halo[HALO][HALO], unsigned char *types)
+{
+	int x, y, exposed;
+	unsigned char t;
+
+	for (y = 1; y <= CHUNKSIZE; y++) {
+		for (x = 1; x <= CHUNKSIZE; x++) {
+			t = halo[y][x];
+			if (t != BLOCK_AIR) {
+				exposed = !halo[y - 1][x] || !halo[y + 1][x] || !halo[y][x - 1] || !halo[y][x + 1];
+				if (exposed && biome != BIOME_SPACE)
+					t = biomeCover[biome];
+				else if (!exposed && noiseHash(seed ^ SALT_DECORATION, chunkX * CHUNKSIZE + x - 1, chunkY * CHUNKSIZE + y - 1) % 97 == 0)
+					t = BLOCK_CRYSTAL;
+			}
+			types[(y - 1) * CHUNKSIZE + x - 1] = t;
+		}
+	}
+}
+
+void worldGenInit(unsigned int worldSeed)
+{
+	seed = worldSeed;
+	lock = SDL_CreateMutex();
+	memset(cache, 0, sizeof(cache));
+}
+
+void worldGenDestroy(void)
+{
+	SDL_DestroyMutex(lock);
+}
+
+int worldGenBiome(int chunkX, int chunkY)
+{
+	struct sector s;
+	int sx = floorDiv(chunkX, SECTORSIZE), sy = floorDiv(chunkY, SECTORSIZE);
+
+	getSector(sx, sy, &s);
+	return s.biomes[chunkY - sy * SECTORSIZE][chunkX - sx * SECTORSIZE];
+}
+
+void worldGenChunk(int chunkX, int chunkY, unsigned char *types)
+{
+	struct sector s;
+	unsigned char halo[HALO][HALO];
+	int sx = floorDiv(chunkX, SECTORSIZE), sy = floorDiv(chunkY, SECTORSIZE);
+	int biome;
+
+	getSector(sx, sy, &s);
+	biome = s.biomes[chunkY - sy * SECTORSIZE][chunkX - sx * SECTORSIZE];
+	fillTerrain(&s, chunkX, chunkY, biome, halo);
+	decorate(chunkX, chunkY, biome, halo, types);
+}
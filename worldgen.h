@@ -0,0 +1,49 @@
+#ifndef _WORLDGEN_H
+#define _WORLDGEN_H
+
+#include "chunk.h"
+
+#define BLOCK_AIR 0
+#define BLOCK_STONE 1
+#define BLOCK_ICE 2
+#define BLOCK_SAND 3
+#define BLOCK_DIRT 4
+#define BLOCK_GRASS 5
+#define BLOCK_SNOW 6
+#define BLOCK_CRYSTAL 7
+#define BLOCK_TYPES 8
+
+#define BIOME_SPACE 0
+#define BIOME_ROCK 1
+#define BIOME_ICE 2
+#define BIOME_DESERT 3
+#define BIOME_JUNGLE 4
+#define BIOMES 5
+
+// sectors are the unit the upstream stages are computed and cached for
+#define SECTORSIZE 16
+#define SECTOR_MAXPLANETS 2
+#define WORLDGEN_CACHE 16
+
+/*
+ * Staged world generation:
+ *
+ *   1. planet layout      per sector, 1 to SECTOR_MAXPLANETS planets
+ *   2. biome assignment   per sector, one biome per chunk
+ *   3. terrain fill       per chunk, planet shape, surface and caves
+ *   4. decoration         per chunk, surface cover and crystals
+ *
+ * Stages 1 and 2 are cached for the last WORLDGEN_CACHE sectors, so the
+ * SECTORSIZE * SECTORSIZE chunks of a sector share that work. Planets
+ * lie wholly inside their sector, so a chunk only needs its own. Everything
+ * is derived from the seed, worldGenChunk() may be called from any
+ * number of threads.
+ */
+void worldGenInit(unsigned int seed);
+void worldGenDestroy(void);
+
+int worldGenBiome(int chunkX, int chunkY);
+// fills a row major CHUNKSIZE * CHUNKSIZE array of BLOCK_* types
+void worldGenChunk(int chunkX, int chunkY, unsigned char *types);
+
+#endif
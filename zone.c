@@ -0,0 +1,147 @@
+#ifdef ZONES
+
+#include <sge.h>
+#include "framesched.h"
+#include "zone.h"
+
+struct zoneevent {
+	const char *name;
+	Uint64 start;
+	Uint64 duration;
+};
+
+struct zonecount {
+	const char *name;
+	Uint32 calls;
+};
+
+struct zonebuffer {
+	Uint32 thread;
+	int depth;
+	const char *open[ZONE_MAXDEPTH];
+	Uint64 started[ZONE_MAXDEPTH];
+	Uint32 count;
+	Uint32 dropped;
+	struct zoneevent events[ZONE_EVENTS];
+	int numNames;
+	struct zonecount names[ZONE_MAXNAMES];
+	struct zonebuffer *next;
+};
+
+static __thread struct zonebuffer *mine = NULL;
+// buffers outlive their threads so they can still be exported
+static struct zonebuffer *buffers = NULL;
+
+static struct zonebuffer *zoneBuffer(void)
+{
+	struct zonebuffer *b;
+
+	if (mine)
+		return mine;
+	sgeNew(b, struct zonebuffer);
+	b->thread = SDL_ThreadID();
+	do {
+		b->next = buffers;
+	} while (!__sync_bool_compare_and_swap(&buffers, b->next, b));
+	mine = b;
+	return b;
+}
+
+void zoneBegin(const char *name)
+{
+	struct zonebuffer *b = zoneBuffer();
+
+	if (b->depth < ZONE_MAXDEPTH) {
+		b->open[b->depth] = name;
+		b->started[b->depth] = frameSchedNow();
+	}
+	b->depth++;
+}
+
+void zoneEnd(void)
+{
+	Uint64 now = frameSchedNow();
+	struct zonebuffer *b = mine;
+	struct zoneevent *e;
+	int i;
+
+	if (!b || !b->depth)
+		return;
+	if (--b->depth >= ZONE_MAXDEPTH)
+		return;
+
+	for (i = 0; i < b->numNames; i++) {
+		if (b->names[i].name == b->open[b->depth])
+			break;
+	}
+	if (i < ZONE_MAXNAMES) {
+		if (i == b->numNames) {
+			b->names[i].name = b->open[b->depth];
+			b->numNames++;
+		}
+		b->names[i].calls++;
+	}
+
+	if (b->count == ZONE_EVENTS) {
+		b->dropped++;
+		return;
+	}
+	e = &b->events[b->count++];
+	e->name = b->open[b->depth];
+	e->start = b->started[b->depth];
+	e->duration = now - e->start;
+}
+
+int zoneExport(const char *filename)
+{
+	struct zonebuffer *b, *o;
+	struct zoneevent *e;
+	const char *separator = "";
+	Uint32 i, calls;
+	int j, k, seen;
+	FILE *f;
+
+	f = fopen(filename, "w");
+	if (!f)
+		return 0;
+	fprintf(f, "{\"traceEvents\":[\n");
+	for (b = buffers; b; b = b->next) {
+		for (i = 0; i < b->count; i++) {
+			e = &b->events[i];
+			fprintf(f, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+				separator, e->name, b->thread, e->start / 1000.0, e->duration / 1000.0);
+			separator = ",\n";
+		}
+	}
+
+	// call counts summed over all threads, including events that were dropped
+	fprintf(f, "\n],\n\"otherData\":{");
+	separator = "";
+	for (b = buffers; b; b = b->next) {
+		for (j = 0; j < b->numNames; j++) {
+			seen = 0;
+			for (o = buffers; o != b && !seen; o = o->next) {
+				for (k = 0; k < o->numNames; k++)
+					seen |= !strcmp(o->names[k].name, b->names[j].name);
+			}
+			if (seen)
+				continue;
+			calls = 0;
+			for (o = b; o; o = o->next) {
+				for (k = 0; k < o->numNames; k++) {
+					if (!strcmp(o->names[k].name, b->names[j].name))
+						calls += o->names[k].calls;
+				}
+			}
+			fprintf(f, "%s\"%s calls\":\"%u\"", separator, b->names[j].name, calls);
+			separator = ",";
+		}
+	}
+	for (b = buffers, calls = 0; b; b = b->next)
+		calls += b->dropped;
+	fprintf(f, "%s\"dropped\":\"%u\"}}\n", separator, calls);
+	fclose(f);
+	return 1;
+}
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef _ZONE_H
+#define _ZONE_H
+
+/*
+ * Scoped timing zones around hot calls, compiled in only when building
+ * with ZONES defined (make ZONES=1). Every thread records into its own
+ * buffer, so zones are free to nest and to be used from the generator
+ * and I/O threads. zoneExport() writes everything recorded as Chrome
+ * trace event JSON, call it after the other threads have stopped.
+ *
+ * Without ZONES the macros expand to nothing.
+ */
+#ifdef ZONES
+
+#define ZONE_EVENTS 65536
+#define ZONE_MAXDEPTH 16
+#define ZONE_MAXNAMES 64
+
+// name must be a string constant, zones are told apart by its address
+#define ZONE_BEGIN(name) zoneBegin(name)
+#define ZONE_END() zoneEnd()
+#define ZONE_EXPORT(filename) zoneExport(filename)
+
+void zoneBegin(const char *name);
+void zoneEnd(void);
+// returns 0 if the file could not be written
+int zoneExport(const char *filename);
+
+#else
+
+#define ZONE_BEGIN(name) do {} while (0)
+#define ZONE_END() do {} while (0)
+#define ZONE_EXPORT(filename) 1
+
+#endif
+
+#endif